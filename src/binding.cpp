@@ -1,4 +1,6 @@
 #include "swayfire.hpp"
+#include "command.hpp"
+#include "overview.hpp"
 
 // Swayfire
 
@@ -32,9 +34,32 @@ bool Swayfire::on_set_want_hsplit(wf::keybinding_t) {
     return false;
 }
 
-bool Swayfire::focus_direction(Direction dir) {
+bool Swayfire::on_set_layout_tabbed(wf::keybinding_t) {
     auto active = get_current_workspace()->get_active_node();
-    if (auto adj = active->parent->get_adjacent(active, dir)) {
+
+    if (active && active->parent) {
+        if (auto parent = active->parent->as_split_node()) {
+            parent->set_split_type(SplitType::TABBED);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Swayfire::on_set_layout_stacked(wf::keybinding_t) {
+    auto active = get_current_workspace()->get_active_node();
+
+    if (active && active->parent) {
+        if (auto parent = active->parent->as_split_node()) {
+            parent->set_split_type(SplitType::STACKED);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Swayfire::focus_direction(Node node, Direction dir) {
+    if (auto adj = node->parent->get_adjacent(node, dir)) {
         if (auto split = adj->as_split_node())
             adj = split->get_last_active_node();
 
@@ -45,20 +70,23 @@ bool Swayfire::focus_direction(Direction dir) {
 }
 
 bool Swayfire::on_focus_left(wf::keybinding_t) {
-    return focus_direction(Direction::LEFT);
+    return focus_direction(get_current_workspace()->get_active_node(),
+                           Direction::LEFT);
 }
 bool Swayfire::on_focus_right(wf::keybinding_t) {
-    return focus_direction(Direction::RIGHT);
+    return focus_direction(get_current_workspace()->get_active_node(),
+                           Direction::RIGHT);
 }
 bool Swayfire::on_focus_down(wf::keybinding_t) {
-    return focus_direction(Direction::DOWN);
+    return focus_direction(get_current_workspace()->get_active_node(),
+                           Direction::DOWN);
 }
 bool Swayfire::on_focus_up(wf::keybinding_t) {
-    return focus_direction(Direction::UP);
+    return focus_direction(get_current_workspace()->get_active_node(),
+                           Direction::UP);
 }
 
-bool Swayfire::on_toggle_focus_tile(wf::keybinding_t) {
-    auto ws = get_current_workspace();
+bool Swayfire::toggle_focus_tile(WorkspaceRef ws) {
     if (ws->get_active_node()->get_floating()) {
         if (auto tiled = ws->get_active_tiled_node())
             tiled->set_active();
@@ -73,12 +101,17 @@ bool Swayfire::on_toggle_focus_tile(wf::keybinding_t) {
     return true;
 }
 
-bool Swayfire::move_direction(Direction dir) {
-    auto ws = get_current_workspace();
-    auto active = ws->get_active_node();
+bool Swayfire::on_toggle_focus_tile(wf::keybinding_t) {
+    return toggle_focus_tile(get_current_workspace());
+}
+
+bool Swayfire::move_direction(Node node, Direction dir) {
+    auto ws = node->get_ws();
+    if (!ws)
+        return false;
 
-    auto old_parent = active->parent;
-    if (!active->parent->move_child(active, dir))
+    auto old_parent = node->parent;
+    if (!node->parent->move_child(node, dir))
         return false;
 
     if (old_parent.get() != ws->tiled_root.get()) {
@@ -87,21 +120,25 @@ bool Swayfire::move_direction(Direction dir) {
         }
     }
 
-    ws->set_active_child(active);
+    ws->set_active_child(node);
     return true;
 }
 
 bool Swayfire::on_move_left(wf::keybinding_t) {
-    return move_direction(Direction::LEFT);
+    return move_direction(get_current_workspace()->get_active_node(),
+                          Direction::LEFT);
 }
 bool Swayfire::on_move_right(wf::keybinding_t) {
-    return move_direction(Direction::RIGHT);
+    return move_direction(get_current_workspace()->get_active_node(),
+                          Direction::RIGHT);
 }
 bool Swayfire::on_move_down(wf::keybinding_t) {
-    return move_direction(Direction::DOWN);
+    return move_direction(get_current_workspace()->get_active_node(),
+                          Direction::DOWN);
 }
 bool Swayfire::on_move_up(wf::keybinding_t) {
-    return move_direction(Direction::UP);
+    return move_direction(get_current_workspace()->get_active_node(),
+                          Direction::UP);
 }
 
 bool Swayfire::on_toggle_tile(wf::keybinding_t) {
@@ -110,15 +147,142 @@ bool Swayfire::on_toggle_tile(wf::keybinding_t) {
     return true;
 }
 
-void Swayfire::bind_keys() {
-    using namespace std::placeholders;
+bool Swayfire::on_toggle_fullscreen(wf::keybinding_t) {
+    auto active = get_current_workspace()->get_active_node();
+    if (!active)
+        return false;
+
+    if (auto view_node = active->as_view_node()) {
+        view_node->set_fullscreen(!view_node->fullscreen);
+        return true;
+    }
+
+    return false;
+}
+
+bool Swayfire::send_to_scratchpad(Node node) {
+    auto ws = node ? node->get_ws() : nullptr;
+    if (!ws || node.get() == ws->tiled_root.get())
+        return false;
+
+    if (ws->fullscreen_node)
+        ws->fullscreen_node->set_fullscreen(false);
+
+    auto owned = ws->remove_node(node);
+    ws->node_removed(node);
+    scratchpad.insert_child(std::move(owned));
+
+    // Only the current ws has focus to hand over.
+    if (ws != get_current_workspace())
+        return true;
+
+    auto new_active = ws->get_active_node();
+    if (new_active && new_active->as_view_node())
+        new_active->set_active();
+    else
+        output->focus_view(nullptr);
+
+    return true;
+}
+
+bool Swayfire::on_send_to_scratchpad(wf::keybinding_t) {
+    return send_to_scratchpad(get_current_workspace()->get_active_node());
+}
+
+bool Swayfire::show_scratchpad() {
+    if (scratchpad.empty())
+        return false;
+
+    auto node = scratchpad.pop();
+    auto node_ref = node.get();
+
+    get_current_workspace()->insert_floating_node(std::move(node));
+    node_ref->set_active();
+
+    return true;
+}
+
+bool Swayfire::on_show_scratchpad(wf::keybinding_t) {
+    return show_scratchpad();
+}
+
+bool Swayfire::on_toggle_overview(wf::keybinding_t) {
+    if (active_grab)
+        return false;
+
+    active_grab = ActiveOverview::construct(this);
+    return active_grab != nullptr;
+}
+
+std::size_t
+Swayfire::get_binding_slot(wf::option_sptr_t<wf::keybinding_t> key) {
+    for (std::size_t i = 0; i < binding_slots.size(); i++)
+        if (binding_slots[i] == key)
+            return i;
+
+    auto slot = binding_slots.size();
+    auto cb = std::make_unique<wf::key_callback>([&, slot](auto b) {
+        auto &actions = current_mode->actions;
+        return slot < actions.size() && actions[slot] && actions[slot](b);
+    });
+    output->add_key(key, cb.get());
+
+    binding_slots.push_back(key);
+    key_callbacks.push_back(std::move(cb));
+    return slot;
+}
+
+void Swayfire::bind_action(const std::string &mode,
+                           wf::option_sptr_t<wf::keybinding_t> key,
+                           BindingAction action) {
+    auto &binding_mode = binding_modes[mode];
+
+    auto value = key->get_value();
+    if (value.get_modifiers() == 0 && value.get_key() == 0)
+        return;
+
+    for (std::size_t i = 0; i < binding_mode.actions.size(); i++) {
+        if (binding_mode.actions[i] &&
+            binding_slots[i]->get_value() == value) {
+            LOGE("Conflicting bindings in mode ", mode, " for ",
+                 key->get_name(), ", the last one wins");
+            binding_mode.actions[i] = nullptr;
+        }
+    }
+
+    binding_mode.bind(get_binding_slot(key), std::move(action));
+}
+
+std::optional<BindingAction>
+Swayfire::parse_action(const std::string &action) {
+    auto builtin = builtin_actions.find(action);
+    if (builtin != builtin_actions.end())
+        return builtin->second;
+
+    if (auto chain = compile_command(action))
+        return [&, chain](auto) { return execute_command(*chain); };
+
+    return {};
+}
+
+bool Swayfire::switch_mode(const std::string &name) {
+    auto mode = binding_modes.find(name);
+    if (mode == binding_modes.end()) {
+        LOGE("No binding mode named ", name);
+        return false;
+    }
+
+    LOGD("switching to binding mode ", name);
+    current_mode = &mode->second;
+    return true;
+}
 
+void Swayfire::bind_keys() {
 #define BIND_KEY(BIND)                                                         \
     {                                                                          \
-        auto cb = std::make_unique<wf::key_callback>(                          \
-            [&](auto b) { return on_##BIND(b); });                             \
-        output->add_key(key_##BIND, cb.get());                                 \
-        key_callbacks.push_back(std::move(cb));                                \
+        BindingAction action = [&](auto b) { return on_##BIND(b); };           \
+        builtin_actions[#BIND] = action;                                       \
+        bind_action(DEFAULT_BINDING_MODE, key_##BIND, action);                 \
     }
 
     BIND_KEY(toggle_split_direction);
@@ -126,6 +290,9 @@ void Swayfire::bind_keys() {
     BIND_KEY(set_want_vsplit);
     BIND_KEY(set_want_hsplit);
 
+    BIND_KEY(set_layout_tabbed);
+    BIND_KEY(set_layout_stacked);
+
     BIND_KEY(focus_left);
     BIND_KEY(focus_right);
     BIND_KEY(focus_down);
@@ -139,10 +306,39 @@ void Swayfire::bind_keys() {
     BIND_KEY(move_up);
 
     BIND_KEY(toggle_tile);
-#undef ADD_KEY
+    BIND_KEY(toggle_fullscreen);
+
+    BIND_KEY(send_to_scratchpad);
+    BIND_KEY(show_scratchpad);
+
+    BIND_KEY(toggle_overview);
+#undef BIND_KEY
+
+    wf::config::compound_list_t<std::string, wf::keybinding_t, std::string>
+        bindings = mode_bindings;
+
+    for (auto &[name, mode, key, action] : bindings) {
+        auto parsed = parse_action(action);
+        if (!parsed) {
+            LOGE("Unknown action for mode binding ", name, ": ", action);
+            continue;
+        }
+
+        auto option = std::make_shared<wf::config::option_t<wf::keybinding_t>>(
+            "swayfire/mode_binding_" + name, key);
+        bind_action(mode, option, *parsed);
+    }
+
+    current_mode = &binding_modes[DEFAULT_BINDING_MODE];
 }
 
 void Swayfire::unbind_keys() {
     std::for_each(key_callbacks.rbegin(), key_callbacks.rend(),
                   [&](auto &cb) { output->rem_binding(cb.get()); });
+
+    key_callbacks.clear();
+    binding_slots.clear();
+    binding_modes.clear();
+    builtin_actions.clear();
+    current_mode = nullptr;
 }
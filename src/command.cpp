@@ -0,0 +1,702 @@
+#include "command.hpp"
+#include "swayfire.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <wayfire/config.h>
+#include <wayfire/util/log.hpp>
+#include <wlr/util/edges.h>
+
+#if WF_HAS_XWAYLAND
+#include <wayfire/nonstd/wlroots-full.hpp>
+#endif
+
+// Pattern
+
+namespace {
+
+/// Characters with a special meaning in ECMAScript regexes.
+const char *const REGEX_SPECIAL = "\\^$.|?*+()[]{}";
+
+bool is_literal(const std::string &source) {
+    return source.find_first_of(REGEX_SPECIAL) == std::string::npos;
+}
+
+} // namespace
+
+std::optional<Pattern> Pattern::parse(const std::string &source) {
+    if (is_literal(source))
+        return Pattern{Kind::SUBSTRING, source, nullptr};
+
+    if (source.size() >= 2 && source.front() == '^' && source.back() == '$') {
+        auto inner = source.substr(1, source.size() - 2);
+        if (is_literal(inner))
+            return Pattern{Kind::EXACT, inner, nullptr};
+    }
+
+    // Regexes are immutable once compiled so every output shares them. The
+    // patterns own them, so they are freed along with the last rule or cached
+    // command using them.
+    static std::unordered_map<std::string, std::weak_ptr<const std::regex>>
+        compiled;
+
+    auto cached = compiled.find(source);
+    if (cached != compiled.end())
+        if (auto regex = cached->second.lock())
+            return Pattern{Kind::REGEX, source, regex};
+
+    try {
+        auto regex = std::make_shared<const std::regex>(source);
+
+        if (compiled.size() >= COMMAND_CACHE_SIZE)
+            for (auto it = compiled.begin(); it != compiled.end();)
+                it = it->second.expired() ? compiled.erase(it) : std::next(it);
+
+        compiled[source] = regex;
+        return Pattern{Kind::REGEX, source, regex};
+    } catch (const std::regex_error &e) {
+        LOGE("Invalid regex \"", source, "\": ", e.what());
+        return {};
+    }
+}
+
+bool Pattern::matches(const std::string &value) const {
+    switch (kind) {
+    case Kind::EXACT:
+        return value == literal;
+    case Kind::SUBSTRING:
+        return value.find(literal) != std::string::npos;
+    case Kind::REGEX:
+        return std::regex_search(value, *regex);
+    }
+    return false;
+}
+
+// Criteria
+
+std::string get_window_role([[maybe_unused]] wayfire_view view) {
+#if WF_HAS_XWAYLAND
+    auto surface = view->get_wlr_surface();
+    if (surface && wlr_surface_is_xwayland_surface(surface)) {
+        auto xsurface = wlr_xwayland_surface_from_wlr_surface(surface);
+        if (xsurface && xsurface->role)
+            return xsurface->role;
+    }
+#endif
+    return {};
+}
+
+bool Criteria::matches(ViewNodeRef node) const {
+    if (con_id && node->get_id() != *con_id)
+        return false;
+
+    if (floating && (bool)node->find_floating_parent() != *floating)
+        return false;
+
+    if (app_id && !app_id->matches(node->view->get_app_id()))
+        return false;
+
+    if (title && !title->matches(node->view->get_title()))
+        return false;
+
+    if (role && !role->matches(get_window_role(node->view)))
+        return false;
+
+    if (con_mark && std::none_of(node->marks.begin(), node->marks.end(),
+                                 [&](const std::string &mark) {
+                                     return con_mark->matches(mark);
+                                 }))
+        return false;
+
+    return true;
+}
+
+// Parser
+
+namespace {
+
+/// Splits a command chain into words.
+struct Lexer {
+    const std::string &src;
+    std::size_t pos = 0;
+
+    void skip_space() {
+        while (pos < src.size() && std::isspace((unsigned char)src[pos]))
+            pos++;
+    }
+
+    bool at_end() {
+        skip_space();
+        return pos >= src.size();
+    }
+
+    /// Get the next non space character without consuming it.
+    char peek() {
+        skip_space();
+        return pos < src.size() ? src[pos] : '\0';
+    }
+
+    /// Read a quoted word or a bare word ending before a space or one of the
+    /// given stop characters.
+    std::optional<std::string> word(const char *stops) {
+        skip_space();
+        if (pos >= src.size())
+            return {};
+
+        char quote = src[pos];
+        if (quote == '"' || quote == '\'') {
+            auto end = src.find(quote, pos + 1);
+            if (end == std::string::npos)
+                return {};
+
+            auto ret = src.substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+            return ret;
+        }
+
+        auto start = pos;
+        while (pos < src.size() && !std::isspace((unsigned char)src[pos]) &&
+               !std::strchr(stops, src[pos]))
+            pos++;
+
+        if (pos == start)
+            return {};
+
+        return src.substr(start, pos - start);
+    }
+};
+
+std::optional<Direction> parse_direction(const std::string &word) {
+    if (word == "left")
+        return Direction::LEFT;
+    if (word == "right")
+        return Direction::RIGHT;
+    if (word == "up")
+        return Direction::UP;
+    if (word == "down")
+        return Direction::DOWN;
+    return {};
+}
+
+std::optional<CommandToggle> parse_toggle(const std::string &word) {
+    if (word == "enable")
+        return CommandToggle::ENABLE;
+    if (word == "disable")
+        return CommandToggle::DISABLE;
+    if (word == "toggle" || word.empty())
+        return CommandToggle::TOGGLE;
+    return {};
+}
+
+// Sway names splits after the direction the children are laid out in while
+// swayfire names them after the direction of the separators.
+std::optional<SplitType> parse_split(const std::string &word) {
+    if (word == "v" || word == "vertical" || word == "splitv")
+        return SplitType::HSPLIT;
+    if (word == "h" || word == "horizontal" || word == "splith")
+        return SplitType::VSPLIT;
+    if (word == "tabbed")
+        return SplitType::TABBED;
+    if (word == "stacking")
+        return SplitType::STACKED;
+    return {};
+}
+
+/// Join the words from the given index on, for names containing spaces.
+std::string join_from(const std::vector<std::string> &words, std::size_t i) {
+    std::string ret;
+    for (; i < words.size(); i++) {
+        if (!ret.empty())
+            ret += ' ';
+        ret += words[i];
+    }
+    return ret;
+}
+
+std::optional<Criteria> parse_criteria(Lexer &lex) {
+    Criteria criteria;
+    lex.pos++; // '['
+
+    while (lex.peek() != ']') {
+        auto key = lex.word("=]");
+        if (!key)
+            return {};
+
+        std::optional<std::string> value;
+        if (lex.peek() == '=') {
+            lex.pos++;
+            if (!(value = lex.word("]")))
+                return {};
+        }
+
+        std::optional<Pattern> *pattern = nullptr;
+        if (*key == "app_id" || *key == "class")
+            pattern = &criteria.app_id;
+        else if (*key == "title")
+            pattern = &criteria.title;
+        else if (*key == "window_role" || *key == "role")
+            pattern = &criteria.role;
+        else if (*key == "con_mark")
+            pattern = &criteria.con_mark;
+
+        if (pattern && value) {
+            if (!(*pattern = Pattern::parse(*value)))
+                return {};
+        } else if (*key == "con_id" && value) {
+            char *end;
+            criteria.con_id = std::strtoul(value->c_str(), &end, 10);
+            if (*end != '\0')
+                return {};
+        } else if (*key == "floating") {
+            criteria.floating = true;
+        } else if (*key == "tiling") {
+            criteria.floating = false;
+        } else {
+            LOGE("Unknown criteria: ", *key);
+            return {};
+        }
+    }
+
+    lex.pos++; // ']'
+    return criteria;
+}
+
+std::optional<Command> parse_single(const std::vector<std::string> &words) {
+    auto word = [&](std::size_t i) {
+        return i < words.size() ? words[i] : std::string();
+    };
+    auto &name = words[0];
+
+    if (name == "focus") {
+        if (words.size() == 1)
+            return Command{CommandOp::FOCUS};
+        if (auto dir = parse_direction(word(1)))
+            return Command{CommandOp::FOCUS_DIRECTION, (int32_t)*dir};
+        if (word(1) == "mode_toggle")
+            return Command{CommandOp::FOCUS_MODE_TOGGLE};
+        return {};
+    }
+
+    if (name == "move") {
+        std::size_t i = 1;
+        if (word(i) == "container" || word(i) == "window")
+            i++;
+
+        if (auto dir = parse_direction(word(i)))
+            return Command{CommandOp::MOVE_DIRECTION, (int32_t)*dir};
+        if (word(i) == "scratchpad")
+            return Command{CommandOp::MOVE_SCRATCHPAD};
+
+        if (word(i) == "to")
+            i++;
+        if (word(i++) != "workspace")
+            return {};
+        if (word(i) == "number")
+            i++;
+
+        Command command{CommandOp::MOVE_TO_WORKSPACE};
+        command.name = join_from(words, i);
+        if (command.name.empty())
+            return {};
+        return command;
+    }
+
+    if (name == "split" || name == "splitv" || name == "splith" ||
+        name == "splitt") {
+        auto arg = name == "split" ? word(1) : name.substr(5);
+        if (arg == "t" || arg == "toggle")
+            return Command{CommandOp::SPLIT_TOGGLE};
+
+        auto split = parse_split(arg);
+        if (!split || *split == SplitType::TABBED ||
+            *split == SplitType::STACKED)
+            return {};
+        return Command{CommandOp::SPLIT, (int32_t)*split};
+    }
+
+    if (name == "layout") {
+        if (word(1) == "toggle" && word(2) == "split")
+            return Command{CommandOp::SPLIT_TOGGLE};
+        if (auto split = parse_split(word(1)))
+            return Command{CommandOp::LAYOUT, (int32_t)*split};
+        return {};
+    }
+
+    if (name == "floating" || name == "fullscreen") {
+        auto toggle = parse_toggle(word(1));
+        if (!toggle || (name == "floating" && word(1).empty()))
+            return {};
+        return Command{name == "floating" ? CommandOp::FLOATING
+                                          : CommandOp::FULLSCREEN,
+                       (int32_t)*toggle};
+    }
+
+    if (name == "scratchpad" && word(1) == "show")
+        return Command{CommandOp::SCRATCHPAD_SHOW};
+
+    if (name == "workspace") {
+        Command command{CommandOp::WORKSPACE};
+        command.name = join_from(words, word(1) == "number" ? 2 : 1);
+        if (command.name.empty())
+            return {};
+        return command;
+    }
+
+    if (name == "resize" && word(1) == "set") {
+        // resize set [width] <w> [px] [[height] <h> [px]]
+        std::vector<int32_t> sizes;
+        for (std::size_t i = 2; i < words.size(); i++) {
+            if (words[i] == "width" || words[i] == "height" ||
+                words[i] == "px")
+                continue;
+
+            char *end;
+            auto size = (int32_t)std::strtol(words[i].c_str(), &end, 10);
+            if (end == words[i].c_str() ||
+                (*end != '\0' && std::strcmp(end, "px") != 0) || size < 0)
+                return {};
+            sizes.push_back(size);
+        }
+
+        if (sizes.empty() || sizes.size() > 2)
+            return {};
+        return Command{CommandOp::RESIZE_SET, sizes[0],
+                       sizes.size() > 1 ? sizes[1] : 0};
+    }
+
+    if (name == "resize") {
+        int32_t sign;
+        if (word(1) == "grow")
+            sign = 1;
+        else if (word(1) == "shrink")
+            sign = -1;
+        else
+            return {};
+
+        int32_t vertical;
+        if (word(2) == "width")
+            vertical = 0;
+        else if (word(2) == "height")
+            vertical = 1;
+        else
+            return {};
+
+        int32_t amount = 10;
+        if (!word(3).empty()) {
+            char *end;
+            amount = (int32_t)std::strtol(word(3).c_str(), &end, 10);
+            if (*end != '\0' && std::strcmp(end, "px") != 0)
+                return {};
+            if (!word(4).empty() && word(4) != "px")
+                return {};
+        }
+
+        return Command{CommandOp::RESIZE, sign * amount, vertical};
+    }
+
+    if (name == "mode") {
+        Command command{CommandOp::MODE};
+        command.name = join_from(words, 1);
+        if (command.name.empty())
+            return {};
+        return command;
+    }
+
+    if (name == "mark") {
+        bool add = word(1) == "--add";
+        Command command{CommandOp::MARK, add};
+        command.name = join_from(words, add ? 2 : 1);
+        if (command.name.empty())
+            return {};
+        return command;
+    }
+
+    if (name == "kill" && words.size() == 1)
+        return Command{CommandOp::KILL};
+
+    return {};
+}
+
+} // namespace
+
+std::shared_ptr<const CommandChain> parse_command(const std::string &source) {
+    auto chain = std::make_shared<CommandChain>();
+    Lexer lex{source};
+    int32_t criteria = -1;
+
+    while (!lex.at_end()) {
+        if (lex.peek() == '[') {
+            auto parsed = parse_criteria(lex);
+            if (!parsed) {
+                LOGE("Invalid criteria in command: ", source);
+                return nullptr;
+            }
+
+            chain->criteria.push_back(std::move(*parsed));
+            criteria = (int32_t)chain->criteria.size() - 1;
+        }
+
+        std::vector<std::string> words;
+        while (auto word = lex.word(";,"))
+            words.push_back(*word);
+
+        if (words.empty()) {
+            LOGE("Empty command in: ", source);
+            return nullptr;
+        }
+
+        auto command = parse_single(words);
+        if (!command) {
+            LOGE("Invalid command \"", join_from(words, 0), "\" in: ", source);
+            return nullptr;
+        }
+
+        command->criteria = criteria;
+        chain->commands.push_back(std::move(*command));
+
+        char sep = lex.peek();
+        if (sep == ';')
+            criteria = -1;
+
+        if (sep == ';' || sep == ',') {
+            lex.pos++;
+        } else if (!lex.at_end()) {
+            LOGE("Unexpected character in command: ", source);
+            return nullptr;
+        }
+    }
+
+    return chain;
+}
+
+// Swayfire
+
+namespace {
+
+bool apply_toggle(int32_t toggle, bool current) {
+    switch ((CommandToggle)toggle) {
+    case CommandToggle::ENABLE:
+        return true;
+    case CommandToggle::DISABLE:
+        return false;
+    case CommandToggle::TOGGLE:
+        return !current;
+    }
+    return current;
+}
+
+} // namespace
+
+std::shared_ptr<const CommandChain>
+Swayfire::compile_command(const std::string &source) {
+    auto cached = command_cache.find(source);
+    if (cached != command_cache.end())
+        return cached->second;
+
+    auto chain = parse_command(source);
+    if (!chain)
+        return nullptr;
+
+    if (command_cache.size() >= COMMAND_CACHE_SIZE)
+        command_cache.clear();
+
+    command_cache.emplace(source, chain);
+    return chain;
+}
+
+bool Swayfire::run_command(const std::string &source) {
+    auto chain = compile_command(source);
+    return chain && execute_command(*chain);
+}
+
+bool Swayfire::execute_command(const CommandChain &chain) {
+    // The whole chain is laid out and configured once at the end.
+    std::vector<wf::point_t> deferred;
+    workspaces.for_each([&](WorkspaceRef ws) {
+        ws->defer_layout();
+        deferred.push_back(ws->wsid);
+    });
+
+    bool ok = true;
+    for (auto &command : chain.commands) {
+        if (command.criteria < 0) {
+            auto active = get_current_workspace()->get_active_node();
+            ok = execute_command(command, active) && ok;
+            continue;
+        }
+
+        auto &criteria = chain.criteria[command.criteria];
+        std::vector<ViewNodeRef> targets;
+        view_nodes.for_each([&](ViewNodeRef node) {
+            if (criteria.matches(node))
+                targets.push_back(node);
+        });
+
+        for (auto &target : targets)
+            ok = execute_command(command, target) && ok;
+    }
+
+    // Workspaces released by switching away have nothing left to lay out.
+    for (auto &wsid : deferred)
+        if (auto ws = workspaces.find(wsid))
+            ws->commit_layout();
+
+    return ok;
+}
+
+void Swayfire::mark_node(ViewNodeRef node, const std::string &mark, bool add) {
+    if (!add)
+        node->marks.clear();
+
+    view_nodes.for_each([&](ViewNodeRef other) { other->marks.erase(mark); });
+    node->marks.insert(mark);
+}
+
+bool Swayfire::execute_command(const Command &command, Node target) {
+    auto ws = target ? target->get_ws() : nullptr;
+    auto view_node = target ? target->as_view_node() : nullptr;
+    auto parent_split = target && target->parent
+                            ? target->parent->as_split_node()
+                            : nullptr;
+
+    switch (command.op) {
+    case CommandOp::FOCUS:
+        if (!ws)
+            return false;
+
+        if (ws != get_current_workspace())
+            switch_to_workspace(ws);
+
+        target->set_active();
+        return true;
+
+    case CommandOp::FOCUS_DIRECTION:
+        return ws && focus_direction(target, (Direction)command.arg);
+
+    case CommandOp::FOCUS_MODE_TOGGLE:
+        return ws && toggle_focus_tile(ws);
+
+    case CommandOp::MOVE_DIRECTION:
+        return ws && move_direction(target, (Direction)command.arg);
+
+    case CommandOp::MOVE_SCRATCHPAD:
+        return send_to_scratchpad(target);
+
+    case CommandOp::MOVE_TO_WORKSPACE: {
+        auto to = workspaces.get_named(command.name);
+        if (!ws || !to || target.get() == ws->tiled_root.get())
+            return false;
+
+        move_to_workspace(target, to);
+        return true;
+    }
+
+    case CommandOp::SPLIT:
+        if (!view_node)
+            return false;
+
+        view_node->prefered_split_type = (SplitType)command.arg;
+        return true;
+
+    case CommandOp::SPLIT_TOGGLE:
+        if (!parent_split)
+            return false;
+
+        parent_split->toggle_split_direction();
+        return true;
+
+    case CommandOp::LAYOUT:
+        if (!parent_split)
+            return false;
+
+        parent_split->set_split_type((SplitType)command.arg);
+        return true;
+
+    case CommandOp::FLOATING:
+        if (!ws || target.get() == ws->tiled_root.get())
+            return false;
+
+        if (apply_toggle(command.arg, target->get_floating()) !=
+            target->get_floating())
+            ws->toggle_tile_node(target);
+        return true;
+
+    case CommandOp::FULLSCREEN:
+        if (!view_node)
+            return false;
+
+        view_node->set_fullscreen(
+            apply_toggle(command.arg, view_node->fullscreen));
+        return true;
+
+    case CommandOp::SCRATCHPAD_SHOW:
+        return show_scratchpad();
+
+    case CommandOp::WORKSPACE:
+        if (auto to = workspaces.get_named(command.name)) {
+            switch_to_workspace(to);
+            return true;
+        }
+        return false;
+
+    case CommandOp::RESIZE: {
+        if (!target)
+            return false;
+
+        if (auto floating = target->find_floating_parent()) {
+            auto geo = floating->get_geometry();
+            wf::dimensions_t size = {geo.width, geo.height};
+            (command.arg2 ? size.height : size.width) += command.arg;
+            floating->try_resize(size, WLR_EDGE_RIGHT | WLR_EDGE_BOTTOM);
+            return true;
+        }
+
+        // Tiled nodes grow within the closest parent split along the
+        // resized dimension.
+        auto split_type = command.arg2 ? SplitType::HSPLIT : SplitType::VSPLIT;
+        Node node = target;
+        for (auto p = node->parent->as_split_node(); p;
+             node = p, p = p->parent->as_split_node())
+            if (p->split_type == split_type && p->children.size() > 1)
+                return p->resize_child(node, command.arg);
+
+        return false;
+    }
+
+    case CommandOp::RESIZE_SET: {
+        auto floating = target ? target->find_floating_parent() : nullptr;
+        if (!floating)
+            return false;
+
+        auto geo = floating->get_geometry();
+        wf::dimensions_t size = {command.arg ? command.arg : geo.width,
+                                 command.arg2 ? command.arg2 : geo.height};
+        floating->try_resize(size, WLR_EDGE_RIGHT | WLR_EDGE_BOTTOM);
+        return true;
+    }
+
+    case CommandOp::MODE:
+        return switch_mode(command.name);
+
+    case CommandOp::MARK:
+        if (!view_node)
+            return false;
+
+        mark_node(view_node, command.name, command.arg);
+        return true;
+
+    case CommandOp::KILL:
+        if (!view_node)
+            return false;
+
+        view_node->view->close();
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,117 @@
+#ifndef COMMAND_HPP
+#define COMMAND_HPP
+
+#include "swayfire.hpp"
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+/// Maximum number of parsed command chains kept in the cache.
+#define COMMAND_CACHE_SIZE 256
+
+/// A criteria value, a regex searched in a view field.
+///
+/// Regexes are only run when needed: a literal anchored on both ends, like
+/// `^foot$`, is compared to the whole field and other literals are searched
+/// as substrings.
+struct Pattern {
+    enum struct Kind : uint8_t {
+        EXACT,     ///< The field must equal literal.
+        SUBSTRING, ///< The field must contain literal.
+        REGEX,     ///< The field must contain a match of regex.
+    };
+
+    Kind kind;
+    std::string literal;
+    std::shared_ptr<const std::regex> regex;
+
+    /// Parse a criteria value.
+    ///
+    /// Compiled regexes are shared by all the live patterns with the same
+    /// source.
+    /// Returns nothing and logs the error if the regex is invalid.
+    static std::optional<Pattern> parse(const std::string &source);
+
+    /// Get whether a field matches this pattern.
+    bool matches(const std::string &value) const;
+};
+
+/// Criteria selecting the views a command applies to, like sway's
+/// `[app_id="foot" title="^vim"]`.
+struct Criteria {
+    std::optional<Pattern> app_id;   ///< Matches the app_id or X11 class.
+    std::optional<Pattern> title;    ///< Matches the title.
+    std::optional<Pattern> role;     ///< Matches the X11 window role.
+    std::optional<Pattern> con_mark; ///< Matches one of the marks.
+    std::optional<uint> con_id;      ///< The id of the view node.
+    std::optional<bool> floating;    ///< Whether the node must be floating.
+
+    /// Get whether a view node matches all the criteria.
+    bool matches(ViewNodeRef node) const;
+};
+
+/// Get the X11 window role of a view, empty for wayland views.
+std::string get_window_role(wayfire_view view);
+
+/// The operation of a parsed command.
+enum struct CommandOp : uint8_t {
+    FOCUS,             ///< Focus the target.
+    FOCUS_DIRECTION,   ///< Focus the node in direction arg from the target.
+    FOCUS_MODE_TOGGLE, ///< Toggle focus between tiled and floating nodes.
+    MOVE_DIRECTION,    ///< Move the target in direction arg.
+    MOVE_SCRATCHPAD,   ///< Send the target to the scratchpad.
+    MOVE_TO_WORKSPACE, ///< Move the target to the ws named name.
+    SPLIT,             ///< Set the split preference of the target to arg.
+    SPLIT_TOGGLE,      ///< Toggle the split direction of the target's parent.
+    LAYOUT,            ///< Set the split type of the target's parent to arg.
+    FLOATING,          ///< Set floating to arg, a CommandToggle.
+    FULLSCREEN,        ///< Set fullscreen to arg, a CommandToggle.
+    SCRATCHPAD_SHOW,   ///< Show the oldest node of the scratchpad.
+    WORKSPACE,         ///< Switch to the ws named name.
+    RESIZE,            ///< Grow the target by arg, width if !arg2 else height.
+    RESIZE_SET,        ///< Resize the target to arg x arg2, 0 keeps a side.
+    MARK,              ///< Mark the target with name, keeping others if arg.
+    MODE,              ///< Switch to the binding mode named name.
+    KILL,              ///< Close the target.
+};
+
+/// The state argument of the boolean commands.
+enum struct CommandToggle : int32_t {
+    DISABLE,
+    ENABLE,
+    TOGGLE,
+};
+
+/// A single parsed command.
+struct Command {
+    CommandOp op;
+
+    int32_t arg;      ///< Direction, split type, toggle or resize amount.
+    int32_t arg2;     ///< Whether a resize is vertical, or a set height.
+    std::string name; ///< Workspace, mode or mark name.
+
+    /// Index of the criteria of the command in the chain, or -1 to apply the
+    /// command to the active node of the current ws.
+    int32_t criteria = -1;
+
+    Command(CommandOp op, int32_t arg = 0, int32_t arg2 = 0)
+        : op(op), arg(arg), arg2(arg2) {}
+};
+
+/// A parsed chain of commands.
+///
+/// Commands are separated by `;`, or by `,` to share the criteria of the
+/// previous command.
+struct CommandChain {
+    std::vector<Criteria> criteria;
+    std::vector<Command> commands;
+};
+
+/// Parse a sway command chain.
+///
+/// Returns nullptr and logs the error if the chain is invalid.
+std::shared_ptr<const CommandChain> parse_command(const std::string &source);
+
+#endif // ifndef COMMAND_HPP
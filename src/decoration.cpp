@@ -0,0 +1,881 @@
+#include "decoration.hpp"
+#include <algorithm>
+#include <cairo.h>
+#include <cmath>
+#include <wayfire/core.hpp>
+#include <wayfire/plugins/common/cairo-util.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/render-manager.hpp>
+
+static const char *vertex_source = R"(
+#version 100
+
+attribute highp vec2 position;
+attribute mediump vec4 color;
+attribute highp vec4 box;
+attribute highp float radius;
+
+varying highp vec2 fpos;
+varying mediump vec4 fcolor;
+varying highp vec4 fbox;
+varying highp float fradius;
+
+uniform mat4 matrix;
+
+void main() {
+    gl_Position = matrix * vec4(position, 0.0, 1.0);
+    fpos = position;
+    fcolor = color;
+    fbox = box;
+    fradius = radius;
+}
+)";
+
+static const char *fragment_source = R"(
+#version 100
+
+precision highp float;
+
+varying highp vec2 fpos;
+varying mediump vec4 fcolor;
+varying highp vec4 fbox;
+varying highp float fradius;
+
+uniform sampler2D mask;
+
+void main() {
+    vec4 color = fcolor;
+
+    if (fradius > 0.0) {
+        vec2 corner = min(fpos - fbox.xy, fbox.zw - fpos);
+        if (corner.x < fradius && corner.y < fradius)
+            color *= texture2D(mask, corner / fradius).a;
+    }
+
+    gl_FragColor = color;
+}
+)";
+
+static const char *shadow_vertex_source = R"(
+#version 100
+
+attribute highp vec2 position;
+attribute highp vec2 uv;
+varying highp vec2 fuv;
+
+uniform mat4 matrix;
+
+void main() {
+    gl_Position = matrix * vec4(position, 0.0, 1.0);
+    fuv = uv;
+}
+)";
+
+static const char *shadow_fragment_source = R"(
+#version 100
+
+precision mediump float;
+
+varying highp vec2 fuv;
+
+uniform sampler2D tex;
+uniform vec4 color;
+
+void main() {
+    gl_FragColor = color * texture2D(tex, fuv).a;
+}
+)";
+
+static const char *view_vertex_source = R"(
+#version 100
+
+attribute highp vec2 position;
+attribute highp vec2 uv_in;
+
+varying highp vec2 uvpos;
+varying highp vec2 fpos;
+
+uniform mat4 matrix;
+
+void main() {
+    gl_Position = matrix * vec4(position, 0.0, 1.0);
+    uvpos = uv_in;
+    fpos = position;
+}
+)";
+
+static const char *view_fragment_source = R"(
+#version 100
+@builtin_ext@
+@builtin@
+
+precision highp float;
+
+varying highp vec2 uvpos;
+varying highp vec2 fpos;
+
+uniform vec4 box;
+uniform float radius;
+uniform sampler2D mask;
+
+void main() {
+    vec4 color = get_pixel(uvpos);
+
+    vec2 corner = min(fpos - box.xy, box.zw - fpos);
+    if (radius > 0.0 && corner.x < radius && corner.y < radius)
+        color *= texture2D(mask, corner / radius).a;
+
+    gl_FragColor = color;
+}
+)";
+
+// RoundedCorners
+
+void RoundedCorners::render_box(wf::texture_t src_tex, wlr_box src_box,
+                                wlr_box scissor_box,
+                                const wf::framebuffer_t &target_fb) {
+    // Views of nodes that are no longer floating are drawn unclipped until
+    // the transformer is detached.
+    wf::geometry_t box = src_box;
+    float radius = 0;
+    if (auto node = decorations->view_nodes->find(view)) {
+        if (auto rounded = decorations->get_rounded_box(node)) {
+            box = rounded->first;
+            radius = rounded->second;
+        }
+    }
+
+    auto &mask = decorations
+                     ->get_corner_textures(decorations->corner_radius,
+                                           target_fb.scale)
+                     .mask;
+    auto &program = decorations->view_program;
+
+    float x1 = src_box.x, y1 = src_box.y;
+    float x2 = src_box.x + src_box.width, y2 = src_box.y + src_box.height;
+    GLfloat vertex_data[] = {x1, y2, x2, y2, x2, y1, x1, y1};
+    GLfloat uv_data[] = {0, 0, 1, 0, 1, 1, 0, 1};
+
+    OpenGL::render_begin(target_fb);
+    target_fb.logic_scissor(scissor_box);
+
+    program.use(src_tex.type);
+    program.set_active_texture(src_tex);
+    program.attrib_pointer("position", 2, 0, vertex_data);
+    program.attrib_pointer("uv_in", 2, 0, uv_data);
+    program.uniformMatrix4f("matrix", target_fb.get_orthographic_projection());
+    program.uniform4f("box", glm::vec4(box.x, box.y, box.x + box.width,
+                                       box.y + box.height));
+    program.uniform1f("radius", radius);
+
+    GL_CALL(glActiveTexture(GL_TEXTURE0 + 1));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, mask.tex));
+    program.uniform1i("mask", 1);
+
+    GL_CALL(glEnable(GL_BLEND));
+    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    GL_CALL(glActiveTexture(GL_TEXTURE0));
+
+    program.deactivate();
+    OpenGL::render_end();
+}
+
+// Decorations
+
+Decorations::Decorations(OutputRef output,
+                         nonstd::observer_ptr<ViewNodeIndex> view_nodes)
+    : output(output), view_nodes(view_nodes) {
+    OpenGL::render_begin();
+    program.set_simple(
+        OpenGL::compile_program(vertex_source, fragment_source));
+    shadow_program.set_simple(OpenGL::compile_program(shadow_vertex_source,
+                                                      shadow_fragment_source));
+    view_program.compile(view_vertex_source, view_fragment_source);
+    OpenGL::render_end();
+
+    for (auto option : {&border_color_focused, &border_color_unfocused,
+                        &border_color_urgent, &title_color_focused,
+                        &title_color_unfocused, &title_color_urgent,
+                        &shadow_color})
+        option->set_callback(on_option_changed);
+    title_font.set_callback(on_option_changed);
+    corner_radius.set_callback(on_corner_radius_changed);
+    shadow_size.set_callback(on_option_changed);
+
+    output->connect_signal(DECORATIONS_DAMAGED_SIGNAL,
+                           &on_decorations_damaged);
+    output->connect_signal(CORNERS_CHANGED_SIGNAL, &on_corners_changed);
+    output->connect_signal("workspace-changed", &on_workspace_changed);
+    output->connect_signal("view-focused", &on_view_focused);
+    output->connect_signal("view-disappeared", &on_view_disappeared);
+    output->connect_signal("view-title-changed", &on_view_title_changed);
+    wf::get_core().connect_signal("view-hints-changed",
+                                  &on_view_hints_changed);
+
+    view_nodes->for_each(
+        [&](ViewNodeRef node) { update_rounded_corners(node); });
+
+    start_rendering();
+    output->render->damage_whole();
+}
+
+Decorations::~Decorations() {
+    wf::get_core().disconnect_signal(&on_view_hints_changed);
+    output->disconnect_signal(&on_view_title_changed);
+    output->disconnect_signal(&on_view_disappeared);
+    output->disconnect_signal(&on_view_focused);
+    output->disconnect_signal(&on_workspace_changed);
+    output->disconnect_signal(&on_corners_changed);
+    output->disconnect_signal(&on_decorations_damaged);
+    stop_rendering();
+
+    for (auto view : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
+        if (view->get_transformer(ROUNDED_CORNERS_TRANSFORMER))
+            view->pop_transformer(ROUNDED_CORNERS_TRANSFORMER);
+
+    output->render->damage_whole();
+
+    titles.clear();
+    headers.clear();
+    corners.clear();
+
+    OpenGL::render_begin();
+    view_program.free_resources();
+    shadow_program.free_resources();
+    program.free_resources();
+    OpenGL::render_end();
+}
+
+std::optional<std::pair<wf::geometry_t, int>>
+Decorations::get_rounded_box(ViewNodeRef node) {
+    if ((int)corner_radius <= 0 || !node->get_ws())
+        return {};
+
+    auto floating = node->find_floating_parent();
+    if (!floating)
+        return {};
+
+    auto box = node->get_ws()->to_output_geometry(floating->get_geometry());
+    int radius = std::min({(int)corner_radius, box.width / 2, box.height / 2});
+    if (radius <= 0)
+        return {};
+
+    return {{box, radius}};
+}
+
+Decorations::CornerTextures &Decorations::get_corner_textures(int radius,
+                                                              float scale) {
+    auto &entry = corners[{radius, scale}];
+    int r = std::max(0, (int)std::ceil(radius * scale));
+
+    if (entry.mask.tex == (GLuint)-1) {
+        // Quarter disc centered on the inner corner of the mask, the outer
+        // corner being the corner of the box.
+        int size = std::max(1, r);
+        std::vector<uint8_t> alpha(size * size);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float d = std::hypot(size - x - 0.5f, size - y - 0.5f);
+                alpha[y * size + x] =
+                    255 * std::clamp(size - d + 0.5f, 0.0f, 1.0f);
+            }
+        }
+        upload_alpha(entry.mask, size, alpha);
+    }
+
+    int s = std::max(0, (int)shadow_size);
+    if (entry.shadow_size != s) {
+        entry.shadow_size = s;
+
+        // Nine-patch of the shadow of a rounded box: corners of s + r texels
+        // and one texel wide edges in between.
+        int sp = std::ceil(s * scale);
+        int corner = sp + r;
+        int size = 2 * corner + 1;
+        std::vector<uint8_t> alpha(size * size);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float qx = std::abs(x + 0.5f - size / 2.0f) - 0.5f;
+                float qy = std::abs(y + 0.5f - size / 2.0f) - 0.5f;
+                float d = std::hypot(std::max(qx, 0.0f), std::max(qy, 0.0f)) +
+                          std::min(std::max(qx, qy), 0.0f) - r;
+                float a = d <= 0 || sp == 0
+                              ? 0
+                              : std::pow(std::max(0.0f, 1 - d / sp), 2.0f);
+                alpha[y * size + x] = 255 * a;
+            }
+        }
+        upload_alpha(entry.shadow, size, alpha);
+
+        entry.corner_uv = (float)corner / size;
+        entry.edge_uv = (float)sp / size;
+    }
+
+    return entry;
+}
+
+void Decorations::upload_alpha(wf::simple_texture_t &tex, int size,
+                               const std::vector<uint8_t> &alpha) {
+    std::vector<uint8_t> pixels(alpha.size() * 4);
+    for (std::size_t i = 0; i < alpha.size(); i++)
+        std::fill_n(pixels.begin() + 4 * i, 4, alpha[i]);
+
+    OpenGL::render_begin();
+    if (tex.tex == (GLuint)-1)
+        GL_CALL(glGenTextures(1, &tex.tex));
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex.tex));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, pixels.data()));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    OpenGL::render_end();
+
+    tex.width = size;
+    tex.height = size;
+}
+
+void Decorations::update_rounded_corners(Node node) {
+    if (auto split = node->as_split_node()) {
+        for (auto &child : split->children)
+            update_rounded_corners(child.node.get());
+        return;
+    }
+
+    auto view_node = node->as_view_node();
+    if (!view_node)
+        return;
+
+    auto view = view_node->view;
+    bool rounded = (int)corner_radius > 0 && !view_node->fullscreen &&
+                   (bool)view_node->find_floating_parent();
+    bool attached = (bool)view->get_transformer(ROUNDED_CORNERS_TRANSFORMER);
+
+    if (rounded && !attached)
+        view->add_transformer(std::make_unique<RoundedCorners>(view, this),
+                              ROUNDED_CORNERS_TRANSFORMER);
+    else if (!rounded && attached)
+        view->pop_transformer(ROUNDED_CORNERS_TRANSFORMER);
+}
+
+DecorationState Decorations::get_state(ViewNodeRef node) {
+    if (node->urgent)
+        return DecorationState::URGENT;
+
+    return node->view->activated ? DecorationState::FOCUSED
+                                 : DecorationState::UNFOCUSED;
+}
+
+wf::color_t Decorations::get_border_color(DecorationState state) {
+    switch (state) {
+    case DecorationState::URGENT:
+        return border_color_urgent;
+    case DecorationState::FOCUSED:
+        return border_color_focused;
+    case DecorationState::UNFOCUSED:
+        return border_color_unfocused;
+    }
+
+    return border_color_unfocused;
+}
+
+wf::color_t Decorations::get_title_color(DecorationState state) {
+    switch (state) {
+    case DecorationState::URGENT:
+        return title_color_urgent;
+    case DecorationState::FOCUSED:
+        return title_color_focused;
+    case DecorationState::UNFOCUSED:
+        return title_color_unfocused;
+    }
+
+    return title_color_unfocused;
+}
+
+void Decorations::push_rect(wf::geometry_t rect, wf::color_t color,
+                            wf::geometry_t box, int radius) {
+    float x1 = rect.x, y1 = rect.y;
+    float x2 = rect.x + rect.width, y2 = rect.y + rect.height;
+
+    // Two triangles per rectangle: colors are premultiplied for blending.
+    vertices.insert(vertices.end(), {x1, y1, x2, y1, x2, y2, //
+                                     x1, y1, x2, y2, x1, y2});
+
+    for (int i = 0; i < 6; i++) {
+        colors.insert(colors.end(),
+                      {(GLfloat)(color.r * color.a),
+                       (GLfloat)(color.g * color.a),
+                       (GLfloat)(color.b * color.a), (GLfloat)color.a});
+        boxes.insert(boxes.end(),
+                     {(GLfloat)box.x, (GLfloat)box.y,
+                      (GLfloat)(box.x + box.width),
+                      (GLfloat)(box.y + box.height)});
+        radii.push_back(radius);
+    }
+}
+
+void Decorations::push_border(ViewNodeRef node, const wf::region_t &covered) {
+    auto region = node->get_border_region() ^ covered;
+    if (region.empty())
+        return;
+
+    auto color = get_border_color(get_state(node));
+    auto rounded = get_rounded_box(node);
+
+    for (const auto &box : region) {
+        if (rounded)
+            push_rect(wlr_box_from_pixman_box(box), color, rounded->first,
+                      rounded->second);
+        else
+            push_rect(wlr_box_from_pixman_box(box), color);
+    }
+}
+
+void Decorations::push_shadow_patch(wf::geometry_t patch, float u1, float v1,
+                                    float u2, float v2,
+                                    const wf::region_t &covered) {
+    if (patch.width <= 0 || patch.height <= 0)
+        return;
+
+    // Texture coordinates of the visible parts are interpolated from the
+    // whole patch.
+    auto u = [&](float x) {
+        return u1 + (x - patch.x) * (u2 - u1) / patch.width;
+    };
+    auto v = [&](float y) {
+        return v1 + (y - patch.y) * (v2 - v1) / patch.height;
+    };
+
+    for (const auto &box : wf::region_t{patch} ^ covered) {
+        float x1 = box.x1, y1 = box.y1, x2 = box.x2, y2 = box.y2;
+
+        shadow_vertices.insert(shadow_vertices.end(),
+                               {x1, y1, x2, y1, x2, y2, //
+                                x1, y1, x2, y2, x1, y2});
+        shadow_uvs.insert(shadow_uvs.end(),
+                          {u(x1), v(y1), u(x2), v(y1), u(x2), v(y2), //
+                           u(x1), v(y1), u(x2), v(y2), u(x1), v(y2)});
+    }
+}
+
+void Decorations::damage_shadow(Node node) {
+    int s = shadow_size;
+    auto floating = node->find_floating_parent();
+    if (s <= 0 || !floating || !node->get_ws())
+        return;
+
+    auto box = node->get_ws()->to_output_geometry(floating->get_geometry());
+    wf::region_t margin{wf::geometry_t{box.x - s, box.y - s,
+                                       box.width + 2 * s, box.height + 2 * s}};
+    output->render->damage(margin ^ box);
+}
+
+void Decorations::push_shadow(ViewNodeRef node, const wf::region_t &covered) {
+    int s = shadow_size;
+    auto floating = node->find_floating_parent();
+    if (s <= 0 || !floating || !frame_corners ||
+        !queued_shadows.insert(floating->get_id()).second)
+        return;
+
+    auto o = node->get_ws()->to_output_geometry(floating->get_geometry());
+    int r = std::max(0, (int)corner_radius);
+    if (o.width < 2 * r || o.height < 2 * r)
+        return;
+
+    float c = frame_corners->corner_uv;
+    float e = frame_corners->edge_uv;
+    int k = s + r;
+    int x2 = o.x + o.width;
+    int y2 = o.y + o.height;
+
+    // Corners.
+    push_shadow_patch({o.x - s, o.y - s, k, k}, 0, 0, c, c, covered);
+    push_shadow_patch({x2 - r, o.y - s, k, k}, 1 - c, 0, 1, c, covered);
+    push_shadow_patch({o.x - s, y2 - r, k, k}, 0, 1 - c, c, 1, covered);
+    push_shadow_patch({x2 - r, y2 - r, k, k}, 1 - c, 1 - c, 1, 1, covered);
+
+    // Edges, stretched from the middle texel.
+    push_shadow_patch({o.x + r, o.y - s, o.width - 2 * r, s}, 0.5, 0, 0.5, e,
+                      covered);
+    push_shadow_patch({o.x + r, y2, o.width - 2 * r, s}, 0.5, 1 - e, 0.5, 1,
+                      covered);
+    push_shadow_patch({o.x - s, o.y + r, s, o.height - 2 * r}, 0, 0.5, e, 0.5,
+                      covered);
+    push_shadow_patch({x2, o.y + r, s, o.height - 2 * r}, 1 - e, 0.5, 1, 0.5,
+                      covered);
+}
+
+void Decorations::push_title(ViewNodeRef node, const wf::region_t &covered) {
+    auto box = node->get_title_geometry();
+    if (!box)
+        return;
+
+    auto region = wf::region_t{*box} ^ covered;
+    if (region.empty())
+        return;
+
+    auto title = node->view->get_title();
+    if (title.empty())
+        return;
+
+    float scale = output->render->get_target_framebuffer().scale;
+    wf::dimensions_t size = {(int)std::ceil(box->width * scale),
+                             (int)std::ceil(box->height * scale)};
+
+    texture_draws.push_back(
+        {get_title_texture(title, size, get_state(node)), *box, region});
+}
+
+void Decorations::push_headers(ViewNodeRef node, const wf::region_t &covered) {
+    float scale = output->render->get_target_framebuffer().scale;
+
+    for (auto p = node->parent; p;) {
+        auto split = p->as_split_node();
+        if (!split)
+            break;
+
+        auto header = split->get_header_geometry();
+        if (header && queued_headers.insert(split->get_id()).second) {
+            auto region = wf::region_t{*header} ^ covered;
+            if (!region.empty()) {
+                wf::dimensions_t size = {
+                    (int)std::ceil(header->width * scale),
+                    (int)std::ceil(header->height * scale)};
+
+                texture_draws.push_back(
+                    {get_header_texture(split, size), *header, region});
+            }
+        }
+
+        p = split->parent;
+    }
+}
+
+void Decorations::invalidate_headers(Node node) {
+    for (auto p = node->parent; p;) {
+        auto split = p->as_split_node();
+        if (!split)
+            break;
+
+        split->invalidate_header();
+        p = split->parent;
+    }
+}
+
+GLuint Decorations::get_title_texture(const std::string &title,
+                                      wf::dimensions_t size,
+                                      DecorationState state) {
+    auto &entry = titles[{title, size.width}];
+    entry.last_used = frame;
+
+    auto &tex = entry.textures[(uint8_t)state];
+    if (tex.tex != (GLuint)-1 && tex.height == size.height)
+        return tex.tex;
+
+    cairo_surface_t *surface;
+    auto cr = begin_text(surface, size, size.height * 0.6);
+    draw_text(cr, title, {0, 0, size.width, size.height},
+              get_title_color(state));
+    end_text(cr, surface, tex);
+
+    return tex.tex;
+}
+
+GLuint Decorations::get_header_texture(SplitNodeRef split,
+                                       wf::dimensions_t size) {
+    auto &entry = headers[split->get_id()];
+    entry.last_used = frame;
+
+    if (entry.texture.tex != (GLuint)-1 &&
+        entry.version == split->header_version && entry.size == size)
+        return entry.texture.tex;
+
+    entry.version = split->header_version;
+    entry.size = size;
+
+    int n = split->children.size();
+    bool tabbed = split->split_type == SplitType::TABBED;
+    int row_height = tabbed ? size.height : size.height / n;
+
+    cairo_surface_t *surface;
+    auto cr = begin_text(surface, size, row_height * 0.6);
+
+    for (int i = 0; i < n; i++) {
+        // Tabs split the header horizontally, stacks have a row per child.
+        wf::geometry_t cell;
+        if (tabbed) {
+            int x1 = size.width * i / n;
+            int x2 = size.width * (i + 1) / n;
+            cell = {x1, 0, x2 - x1, size.height};
+        } else {
+            cell = {0, row_height * i, size.width, row_height};
+        }
+
+        // Splits are titled after their last active view.
+        Node child = split->children[i].node.get();
+        Node last_active = child;
+        if (auto child_split = child->as_split_node())
+            last_active = child_split->get_last_active_node();
+
+        ViewNodeRef view_node = last_active ? last_active->as_view_node()
+                                            : nullptr;
+        auto state =
+            view_node ? get_state(view_node) : DecorationState::UNFOCUSED;
+
+        auto bg = get_border_color(state);
+        cairo_set_source_rgba(cr, bg.r, bg.g, bg.b, bg.a);
+        cairo_rectangle(cr, cell.x, cell.y, cell.width, cell.height);
+        cairo_fill(cr);
+
+        if (view_node)
+            draw_text(cr, view_node->view->get_title(), cell,
+                      get_title_color(state));
+    }
+
+    end_text(cr, surface, entry.texture);
+    return entry.texture.tex;
+}
+
+cairo_t *Decorations::begin_text(cairo_surface_t *&surface,
+                                 wf::dimensions_t size, double font_size) {
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size.width,
+                                         size.height);
+    auto cr = cairo_create(surface);
+
+    cairo_select_font_face(cr, ((std::string)title_font).c_str(),
+                           CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, font_size);
+
+    return cr;
+}
+
+void Decorations::draw_text(cairo_t *cr, const std::string &text,
+                            wf::geometry_t cell, wf::color_t color) {
+    float scale = output->render->get_target_framebuffer().scale;
+    double padding = TITLE_PADDING * scale;
+
+    cairo_font_extents_t extents;
+    cairo_font_extents(cr, &extents);
+
+    cairo_save(cr);
+    cairo_rectangle(cr, cell.x + padding, cell.y, cell.width - 2 * padding,
+                    cell.height);
+    cairo_clip(cr);
+
+    cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+    cairo_move_to(cr, cell.x + padding,
+                  cell.y + (cell.height - extents.height) / 2 +
+                      extents.ascent);
+    cairo_show_text(cr, text.c_str());
+
+    cairo_restore(cr);
+}
+
+void Decorations::end_text(cairo_t *cr, cairo_surface_t *surface,
+                           wf::simple_texture_t &tex) {
+    cairo_destroy(cr);
+
+    OpenGL::render_begin();
+    cairo_surface_upload_to_texture(surface, tex);
+    OpenGL::render_end();
+
+    cairo_surface_destroy(surface);
+}
+
+void Decorations::evict_textures() {
+    if (frame % TITLE_CACHE_FRAMES)
+        return;
+
+    for (auto it = titles.begin(); it != titles.end();) {
+        if (it->second.last_used + TITLE_CACHE_FRAMES < frame)
+            it = titles.erase(it);
+        else
+            ++it;
+    }
+
+    for (auto it = headers.begin(); it != headers.end();) {
+        if (it->second.last_used + TITLE_CACHE_FRAMES < frame)
+            it = headers.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Decorations::draw_batch(const wf::region_t &damage) {
+    auto fb = output->render->get_target_framebuffer();
+
+    OpenGL::render_begin(fb);
+
+    GL_CALL(glEnable(GL_BLEND));
+    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+
+    if (!vertices.empty()) {
+        program.use(wf::TEXTURE_TYPE_RGBA);
+        program.attrib_pointer("position", 2, 0, vertices.data());
+        program.attrib_pointer("color", 4, 0, colors.data());
+        program.attrib_pointer("box", 4, 0, boxes.data());
+        program.attrib_pointer("radius", 1, 0, radii.data());
+        program.uniformMatrix4f("matrix", fb.get_orthographic_projection());
+
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D,
+                              frame_corners ? frame_corners->mask.tex : 0));
+        program.uniform1i("mask", 0);
+
+        for (const auto &box : damage) {
+            fb.logic_scissor(wlr_box_from_pixman_box(box));
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 2));
+        }
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        program.deactivate();
+    }
+
+    for (auto &draw : texture_draws) {
+        for (const auto &box : draw.region & damage) {
+            fb.logic_scissor(wlr_box_from_pixman_box(box));
+            OpenGL::render_texture(draw.tex, fb, draw.box, glm::vec4(1.0f),
+                                   OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+        }
+    }
+
+    // Shadows go last to darken the decorations of the nodes below.
+    if (!shadow_vertices.empty()) {
+        wf::color_t color = shadow_color;
+        shadow_program.use(wf::TEXTURE_TYPE_RGBA);
+        shadow_program.attrib_pointer("position", 2, 0,
+                                      shadow_vertices.data());
+        shadow_program.attrib_pointer("uv", 2, 0, shadow_uvs.data());
+        shadow_program.uniformMatrix4f("matrix",
+                                       fb.get_orthographic_projection());
+        shadow_program.uniform4f("color",
+                                 glm::vec4(color.r * color.a, color.g * color.a,
+                                           color.b * color.a, color.a));
+
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, frame_corners->shadow.tex));
+        shadow_program.uniform1i("tex", 0);
+
+        for (const auto &box : damage) {
+            fb.logic_scissor(wlr_box_from_pixman_box(box));
+            GL_CALL(
+                glDrawArrays(GL_TRIANGLES, 0, shadow_vertices.size() / 2));
+        }
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        shadow_program.deactivate();
+    }
+
+    OpenGL::render_end();
+}
+
+void Decorations::start_rendering() {
+    if (rendering || suspended)
+        return;
+
+    rendering = true;
+    output->render->add_effect(&on_render, wf::OUTPUT_EFFECT_OVERLAY);
+}
+
+void Decorations::stop_rendering() {
+    if (!rendering)
+        return;
+
+    rendering = false;
+    output->render->rem_effect(&on_render);
+}
+
+void Decorations::set_suspended(bool suspend) {
+    suspended = suspend;
+
+    if (suspended)
+        stop_rendering();
+    else
+        start_rendering();
+}
+
+bool Decorations::is_decorated(ViewNodeRef node) {
+    if (!node->get_border_region().empty())
+        return true;
+
+    if (node->find_floating_parent() && (int)shadow_size > 0)
+        return true;
+
+    for (auto p = node->parent; p;) {
+        auto split = p->as_split_node();
+        if (!split)
+            break;
+
+        if (split->get_header_geometry())
+            return true;
+
+        p = split->parent;
+    }
+
+    return false;
+}
+
+bool Decorations::render(const wf::region_t &damage) {
+    frame++;
+    vertices.clear();
+    colors.clear();
+    boxes.clear();
+    radii.clear();
+    shadow_vertices.clear();
+    shadow_uvs.clear();
+    texture_draws.clear();
+    queued_headers.clear();
+    queued_shadows.clear();
+
+    auto screen = output->get_relative_geometry();
+
+    // All the floating nodes share the corner textures of the frame.
+    frame_corners = nullptr;
+    if ((int)corner_radius > 0 || (int)shadow_size > 0)
+        frame_corners = &get_corner_textures(
+            std::max(0, (int)corner_radius),
+            output->render->get_target_framebuffer().scale);
+
+    // Walk the views from the top down so that decorations are clipped by
+    // whatever is stacked above them.
+    wf::region_t covered;
+    bool decorated = false;
+    for (auto view : output->workspace->get_views_in_layer(wf::ALL_LAYERS)) {
+        if (!view->is_mapped() || !view->is_visible())
+            continue;
+
+        auto bbox = view->get_bounding_box();
+        if (!(bbox & screen))
+            continue;
+
+        // Fullscreen views are left undecorated so they can be scanned out.
+        auto node = view_nodes->find(view);
+        if (node && !node->fullscreen) {
+            decorated = decorated || is_decorated(node);
+            push_shadow(node, covered);
+            push_border(node, covered);
+            push_title(node, covered);
+            push_headers(node, covered);
+            covered |= node->get_border_region();
+        }
+
+        covered |= bbox;
+    }
+
+    auto frame_damage = damage & screen;
+    if (!frame_damage.empty() &&
+        (!vertices.empty() || !texture_draws.empty() ||
+         !shadow_vertices.empty()))
+        draw_batch(frame_damage);
+
+    evict_textures();
+    return decorated;
+}
@@ -0,0 +1,440 @@
+#ifndef DECORATION_HPP
+#define DECORATION_HPP
+
+#include "swayfire.hpp"
+#include <cairo.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <wayfire/opengl.hpp>
+#include <wayfire/plugins/common/simple-texture.hpp>
+
+/// Number of frames a rasterised title or header survives without being
+/// drawn.
+#define TITLE_CACHE_FRAMES 600
+
+/// Horizontal padding of title text in its title bar.
+#define TITLE_PADDING 4
+
+/// Name of the transformer rounding the corners of floating views.
+#define ROUNDED_CORNERS_TRANSFORMER "swayfire-rounded-corners"
+
+/// The state in which a node is decorated.
+enum struct DecorationState : uint8_t {
+    UNFOCUSED = 0,
+    FOCUSED = 1,
+    URGENT = 2,
+};
+
+class Decorations;
+
+/// Transformer clipping a floating view to the rounded outer geometry of its
+/// floating node.
+///
+/// Only the corners are masked, with the corner mask shared by all floating
+/// nodes.
+class RoundedCorners : public wf::view_transformer_t {
+  private:
+    wayfire_view view;
+    nonstd::observer_ptr<Decorations> decorations;
+
+  public:
+    RoundedCorners(wayfire_view view,
+                   nonstd::observer_ptr<Decorations> decorations)
+        : view(view), decorations(decorations) {}
+
+    uint32_t get_z_order() override { return wf::TRANSFORMER_HIGHLEVEL; }
+
+    wf::pointf_t transform_point(wf::geometry_t, wf::pointf_t point) override {
+        return point;
+    }
+
+    wf::pointf_t untransform_point(wf::geometry_t,
+                                   wf::pointf_t point) override {
+        return point;
+    }
+
+    wlr_box get_bounding_box(wf::geometry_t, wlr_box region) override {
+        return region;
+    }
+
+    void render_box(wf::texture_t src_tex, wlr_box src_box,
+                    wlr_box scissor_box,
+                    const wf::framebuffer_t &target_fb) override;
+};
+
+/// Renderer of the decorations of the nodes of an output.
+///
+/// Decorations are not drawn by per-view surfaces or transformers: one
+/// overlay hook collects them from the layout of the visible views and draws
+/// the borders and shadows in a single batch. The rasterised titles and
+/// headers each have their own texture, so they are drawn after the batch
+/// with one textured quad each.
+///
+/// The hook is only registered while some visible view is decorated, so
+/// that outputs without decorations keep direct scanout and skip the walk
+/// over their views. Decoration damage registers it again.
+class Decorations {
+    friend RoundedCorners;
+
+  private:
+    /// Key of a rasterised title.
+    struct TitleKey {
+        std::string title; ///< The text of the title.
+        int width;         ///< The width of the title bar in device pixels.
+
+        bool operator==(const TitleKey &other) const {
+            return width == other.width && title == other.title;
+        }
+    };
+
+    struct TitleKeyHash {
+        std::size_t operator()(const TitleKey &key) const {
+            return std::hash<std::string>()(key.title) ^
+                   (std::hash<int>()(key.width) << 1);
+        }
+    };
+
+    /// The rasterised variants of a title, one per DecorationState.
+    ///
+    /// Variants are rasterised on first use so switching focus back and forth
+    /// only swaps textures.
+    struct TitleEntry {
+        wf::simple_texture_t textures[3];
+        uint64_t last_used = 0;
+    };
+
+    /// The rasterised header of a tabbed or stacked split.
+    struct HeaderEntry {
+        uint64_t version = 0;    ///< The header version rasterised.
+        wf::dimensions_t size{}; ///< The size rasterised in device pixels.
+        wf::simple_texture_t texture;
+        uint64_t last_used = 0;
+    };
+
+    /// The textures shared by all floating nodes for a (radius, scale).
+    struct CornerTextures {
+        wf::simple_texture_t mask;   ///< Quarter disc of the corners.
+        wf::simple_texture_t shadow; ///< Nine-patch of the shadows.
+        int shadow_size = -1;        ///< The shadow size rasterised.
+        float corner_uv = 0; ///< Texture extent of the nine-patch corners.
+        float edge_uv = 0;   ///< Texture extent of the nine-patch edges.
+    };
+
+    /// A title or header texture to draw after the batch.
+    struct TextureDraw {
+        GLuint tex;          ///< The rasterised title or header.
+        wf::geometry_t box;  ///< The output geometry to draw it at.
+        wf::region_t region; ///< The visible part of box.
+    };
+
+    /// The output rendered to.
+    OutputRef output;
+
+    /// The view nodes of the output.
+    nonstd::observer_ptr<ViewNodeIndex> view_nodes;
+
+    /// Shader drawing colored triangles optionally clipped to rounded boxes.
+    OpenGL::program_t program;
+
+    /// Shader drawing the shadow nine-patches.
+    OpenGL::program_t shadow_program;
+
+    /// Shader drawing view textures clipped to rounded boxes.
+    OpenGL::program_t view_program;
+
+    /// Vertex positions of the current batch, two floats per vertex.
+    std::vector<GLfloat> vertices;
+
+    /// Vertex colors of the current batch, four floats per vertex.
+    std::vector<GLfloat> colors;
+
+    /// The rounded box clipping each vertex of the current batch, four floats
+    /// per vertex.
+    std::vector<GLfloat> boxes;
+
+    /// The corner radius of each vertex of the current batch, 0 if unclipped.
+    std::vector<GLfloat> radii;
+
+    /// Vertex positions of the current shadow batch, two floats per vertex.
+    std::vector<GLfloat> shadow_vertices;
+
+    /// Texture coordinates of the current shadow batch, two floats per vertex.
+    std::vector<GLfloat> shadow_uvs;
+
+    /// The corner textures by (radius, scale).
+    std::map<std::pair<int, float>, CornerTextures> corners;
+
+    /// The corner textures used by the current frame, if any.
+    nonstd::observer_ptr<CornerTextures> frame_corners;
+
+    /// Ids of the floating nodes whose shadow was queued in the current frame.
+    std::unordered_set<uint> queued_shadows;
+
+    /// The titles and headers to draw on top of the current batch.
+    std::vector<TextureDraw> texture_draws;
+
+    /// The rasterised titles of the output.
+    std::unordered_map<TitleKey, TitleEntry, TitleKeyHash> titles;
+
+    /// The rasterised headers of the output by split node id.
+    std::unordered_map<uint, HeaderEntry> headers;
+
+    /// Ids of the splits whose header was queued in the current frame.
+    std::unordered_set<uint> queued_headers;
+
+    /// Frame counter used to evict titles and headers no longer drawn.
+    uint64_t frame = 0;
+
+    /// The last focused view, whose border must be repainted on focus change.
+    wayfire_view last_focused;
+
+    wf::option_wrapper_t<wf::color_t> border_color_focused{
+        "swayfire/border_color_focused"};
+    wf::option_wrapper_t<wf::color_t> border_color_unfocused{
+        "swayfire/border_color_unfocused"};
+    wf::option_wrapper_t<wf::color_t> border_color_urgent{
+        "swayfire/border_color_urgent"};
+
+    wf::option_wrapper_t<wf::color_t> title_color_focused{
+        "swayfire/title_color_focused"};
+    wf::option_wrapper_t<wf::color_t> title_color_unfocused{
+        "swayfire/title_color_unfocused"};
+    wf::option_wrapper_t<wf::color_t> title_color_urgent{
+        "swayfire/title_color_urgent"};
+
+    wf::option_wrapper_t<std::string> title_font{"swayfire/title_font"};
+
+    wf::option_wrapper_t<int> corner_radius{"swayfire/corner_radius"};
+    wf::option_wrapper_t<int> shadow_size{"swayfire/shadow_size"};
+    wf::option_wrapper_t<wf::color_t> shadow_color{"swayfire/shadow_color"};
+
+    /// Get the output geometry of the rounded box clipping a node and its
+    /// corner radius, if the node is floating and corners are rounded.
+    std::optional<std::pair<wf::geometry_t, int>>
+    get_rounded_box(ViewNodeRef node);
+
+    /// Get the corner textures of the given radius and scale, rasterising
+    /// them on first use.
+    CornerTextures &get_corner_textures(int radius, float scale);
+
+    /// Upload an alpha-only image as a premultiplied white texture.
+    static void upload_alpha(wf::simple_texture_t &tex, int size,
+                             const std::vector<uint8_t> &alpha);
+
+    /// Attach or detach the rounded corners transformers of the views of a
+    /// node.
+    void update_rounded_corners(Node node);
+
+    /// Get the state in which the given node is decorated.
+    static DecorationState get_state(ViewNodeRef node);
+
+    /// Get the border and title bar background color of the given state.
+    wf::color_t get_border_color(DecorationState state);
+
+    /// Get the title text color of the given state.
+    wf::color_t get_title_color(DecorationState state);
+
+    /// Append a solid rectangle to the current batch, optionally clipped to
+    /// a rounded box.
+    void push_rect(wf::geometry_t rect, wf::color_t color,
+                   wf::geometry_t box = {}, int radius = 0);
+
+    /// Append the visible parts of a patch of the shadow nine-patch to the
+    /// current shadow batch.
+    void push_shadow_patch(wf::geometry_t patch, float u1, float v1, float u2,
+                           float v2, const wf::region_t &covered);
+
+    /// Append the shadow of the floating parent of a node to the current
+    /// shadow batch.
+    void push_shadow(ViewNodeRef node, const wf::region_t &covered);
+
+    /// Append the visible parts of the border of a node to the current batch.
+    void push_border(ViewNodeRef node, const wf::region_t &covered);
+
+    /// Queue the title of a node to be drawn on top of the current batch.
+    void push_title(ViewNodeRef node, const wf::region_t &covered);
+
+    /// Queue the headers of the tabbed and stacked splits containing a node
+    /// to be drawn on top of the current batch.
+    void push_headers(ViewNodeRef node, const wf::region_t &covered);
+
+    /// Get the texture of a title, rasterising it if it isn't cached.
+    GLuint get_title_texture(const std::string &title, wf::dimensions_t size,
+                             DecorationState state);
+
+    /// Get the texture of the header of a split, rasterising it if its
+    /// version or size changed.
+    GLuint get_header_texture(SplitNodeRef split, wf::dimensions_t size);
+
+    /// Prepare a cairo context for drawing text on a surface of the given
+    /// size.
+    cairo_t *begin_text(cairo_surface_t *&surface, wf::dimensions_t size,
+                        double font_size);
+
+    /// Draw text vertically centered in a cell, clipped to its width.
+    void draw_text(cairo_t *cr, const std::string &text, wf::geometry_t cell,
+                   wf::color_t color);
+
+    /// Upload the surface of a cairo context to a texture and destroy both.
+    void end_text(cairo_t *cr, cairo_surface_t *surface,
+                  wf::simple_texture_t &tex);
+
+    /// Release the titles and headers that haven't been drawn for
+    /// TITLE_CACHE_FRAMES.
+    void evict_textures();
+
+    /// Invalidate the headers of the tabbed and stacked splits containing a
+    /// node.
+    static void invalidate_headers(Node node);
+
+    /// Draw the current batch in one call, clipped to the frame damage.
+    void draw_batch(const wf::region_t &damage);
+
+    /// Get whether a visible node has decorations to draw.
+    bool is_decorated(ViewNodeRef node);
+
+    /// Collect the decorations of all the visible views and draw their
+    /// damaged parts.
+    ///
+    /// Only the damage is repainted under the overlay, drawing translucent
+    /// decorations anywhere else would blend them over themselves.
+    ///
+    /// \return Whether any visible view is decorated.
+    bool render(const wf::region_t &damage);
+
+    /// Whether on_render is registered.
+    bool rendering = false;
+
+    /// Whether drawing is suspended, see set_suspended().
+    bool suspended = false;
+
+    /// Register on_render if it isn't.
+    void start_rendering();
+
+    /// Unregister on_render if it is.
+    void stop_rendering();
+
+    /// Draw the decorations over the views of the output, and stop once
+    /// there are none.
+    wf::effect_hook_t on_render = [&]() {
+        if (!render(output->render->get_scheduled_damage()))
+            stop_rendering();
+    };
+
+    /// Damage the shadow around the floating parent of a node.
+    void damage_shadow(Node node);
+
+    /// Wake the renderer up when decorations may have appeared.
+    wf::signal_connection_t on_decorations_damaged =
+        [&](wf::signal_data_t *data) {
+            start_rendering();
+
+            auto signal = static_cast<DecorationsDamagedSignal *>(data);
+            if (signal->node)
+                damage_shadow(signal->node);
+        };
+
+    /// Wake the renderer up for the views of the new current ws.
+    wf::signal_connection_t on_workspace_changed =
+        [&](wf::signal_data_t *) { start_rendering(); };
+
+    /// Redraw everything when a decoration option changes.
+    std::function<void()> on_option_changed = [&]() {
+        start_rendering();
+        output->render->damage_whole();
+    };
+
+    /// Round the corners of the floating views, or stop, when the radius
+    /// changes.
+    std::function<void()> on_corner_radius_changed = [&]() {
+        view_nodes->for_each(
+            [&](ViewNodeRef node) { update_rounded_corners(node); });
+        on_option_changed();
+    };
+
+    /// Keep the rounded corners transformers up to date.
+    wf::signal_connection_t on_corners_changed = [&](wf::signal_data_t *data) {
+        update_rounded_corners(static_cast<CornersChangedSignal *>(data)->node);
+    };
+
+    /// Repaint the borders of the previously and newly focused views.
+    wf::signal_connection_t on_view_focused = [&](wf::signal_data_t *data) {
+        auto view = wf::get_signaled_view(data);
+
+        if (last_focused)
+            if (auto node = view_nodes->find(last_focused)) {
+                node->damage_border();
+                invalidate_headers(node);
+            }
+
+        last_focused = view;
+
+        if (view)
+            if (auto node = view_nodes->find(view)) {
+                node->urgent = false;
+                node->damage_border();
+                invalidate_headers(node);
+            }
+    };
+
+    /// Forget the focused view when it leaves the output.
+    wf::signal_connection_t on_view_disappeared =
+        [&](wf::signal_data_t *data) {
+            if (wf::get_signaled_view(data) == last_focused)
+                last_focused = nullptr;
+        };
+
+    /// Track the urgency of views.
+    wf::signal_connection_t on_view_hints_changed =
+        [&](wf::signal_data_t *data) {
+            auto signal = static_cast<wf::view_hints_changed_signal *>(data);
+            if (signal->view->get_output() != output.get())
+                return;
+
+            auto node = view_nodes->find(signal->view);
+            bool urgent =
+                signal->demands_attention && !signal->view->activated;
+            if (!node || node->urgent == urgent)
+                return;
+
+            node->urgent = urgent;
+            node->damage_border();
+            invalidate_headers(node);
+        };
+
+    /// Repaint the title bar and the headers of retitled views.
+    ///
+    /// Clients retitling themselves with the same text are ignored, so they
+    /// cost no repaint nor rasterisation.
+    wf::signal_connection_t on_view_title_changed =
+        [&](wf::signal_data_t *data) {
+            auto view = wf::get_signaled_view(data);
+            auto node = view_nodes->find(view);
+            if (!node || node->title == view->get_title())
+                return;
+
+            node->title = view->get_title();
+
+            if (auto box = node->get_title_geometry()) {
+                start_rendering();
+                output->render->damage(*box);
+            }
+
+            invalidate_headers(node);
+        };
+
+  public:
+    Decorations(OutputRef output,
+                nonstd::observer_ptr<ViewNodeIndex> view_nodes);
+    ~Decorations();
+
+    /// Stop or resume drawing the decorations, while something else renders
+    /// the output.
+    void set_suspended(bool suspend);
+};
+
+#endif // ifndef DECORATION_HPP
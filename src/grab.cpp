@@ -8,7 +8,9 @@
 #include <wayfire/geometry.hpp>
 #include <wayfire/nonstd/observer_ptr.h>
 #include <wayfire/nonstd/wlroots-full.hpp>
+#include <wayfire/opengl.hpp>
 #include <wayfire/plugin.hpp>
+#include <wayfire/render-manager.hpp>
 #include <wlr/util/edges.h>
 
 // IActiveGrab
@@ -105,6 +107,65 @@ uint32_t resize_calc_resizing_edges(wf::geometry_t geo, wf::point_t p) {
 }
 #undef RESIZE_MARGIN
 
+void ActiveResize::set_preview_geo(wf::geometry_t geo) {
+    plugin->output->render->damage(preview_box);
+    preview_geo = geo;
+    preview_box = dragged->get_ws()->to_output_geometry(geo);
+    plugin->output->render->damage(preview_box);
+}
+
+#define PREVIEW_BORDER 2
+void ActiveResize::render_preview_outline() {
+    auto fb = plugin->output->render->get_target_framebuffer();
+    auto box = preview_box;
+
+    auto damage = plugin->output->render->get_scheduled_damage() & box;
+    if (damage.empty())
+        return;
+
+    wf::color_t color = plugin->resize_preview_color;
+    wf::color_t fill = {color.r * color.a, color.g * color.a,
+                        color.b * color.a, color.a};
+    wf::color_t edge = {color.r, color.g, color.b, 1.0};
+
+    wf::geometry_t edges[] = {
+        {box.x, box.y, box.width, PREVIEW_BORDER},
+        {box.x, box.y + box.height - PREVIEW_BORDER, box.width,
+         PREVIEW_BORDER},
+        {box.x, box.y, PREVIEW_BORDER, box.height},
+        {box.x + box.width - PREVIEW_BORDER, box.y, PREVIEW_BORDER,
+         box.height},
+    };
+
+    OpenGL::render_begin(fb);
+    for (const auto &b : damage) {
+        fb.logic_scissor(wlr_box_from_pixman_box(b));
+        OpenGL::render_rectangle(box, fill, fb.get_orthographic_projection());
+        for (auto &e : edges)
+            OpenGL::render_rectangle(e, edge,
+                                     fb.get_orthographic_projection());
+    }
+    OpenGL::render_end();
+}
+#undef PREVIEW_BORDER
+
+ActiveResize::~ActiveResize() {
+    // The dragged node may already be gone here, so only the saved outline
+    // is used.
+    if (preview) {
+        plugin->output->render->rem_effect(&render_preview);
+        plugin->output->render->damage(preview_box);
+    }
+}
+
+void ActiveResize::button(uint32_t b, uint32_t state) {
+    if (preview && b == deactivate_button && state == WLR_BUTTON_RELEASED &&
+        preview_geo != original_geo)
+        dragged->set_geometry(preview_geo);
+
+    IActiveButtonDrag::button(b, state);
+}
+
 void ActiveResize::pointer_motion(uint32_t x, uint32_t y) {
     int dw = (int)x - pointer_start.x;
     int dh = (int)y - pointer_start.y;
@@ -117,7 +178,12 @@ void ActiveResize::pointer_motion(uint32_t x, uint32_t y) {
     int nh = (resizing_edges & WLR_EDGE_TOP) ? original_geo.height - dh
                                              : original_geo.height + dh;
 
-    dragged->try_resize({nw, nh}, resizing_edges);
+    if (preview) {
+        // Only repaint the outline, the client is configured on release.
+        set_preview_geo(dragged->calc_resize({nw, nh}, resizing_edges));
+    } else {
+        dragged->try_resize({nw, nh}, resizing_edges);
+    }
 }
 
 std::unique_ptr<IActiveGrab>
@@ -134,6 +200,13 @@ ActiveResize::construct(nonstd::observer_ptr<Swayfire> plugin, Node dragged) {
         ret->resizing_edges =
             resize_calc_resizing_edges(ret->original_geo, ret->pointer_start);
 
+        ret->preview = plugin->resize_preview;
+        if (ret->preview) {
+            ret->set_preview_geo(ret->original_geo);
+            plugin->output->render->add_effect(&ret->render_preview,
+                                               wf::OUTPUT_EFFECT_OVERLAY);
+        }
+
         wf::get_core().set_cursor(
             wlr_xcursor_get_resize_name((wlr_edges)(ret->resizing_edges)));
 
@@ -148,26 +221,42 @@ void Swayfire::init_grab_interface() {
     grab_interface->capabilities =
         wf::CAPABILITY_GRAB_INPUT | wf::CAPABILITY_MANAGE_DESKTOP;
 
+    // Motion events can arrive much faster than the output refreshes, so
+    // only the latest position is kept and applied at the next frame.
     grab_interface->callbacks.pointer.motion = [&](uint32_t x, uint32_t y) {
-        if (active_grab)
-            active_grab->pointer_motion(x, y);
+        if (active_grab) {
+            pending_motion = {(int)x, (int)y};
+            output->render->schedule_redraw();
+        }
     };
 
     grab_interface->callbacks.pointer.button = [&](uint32_t b, uint32_t state) {
-        if (active_grab)
+        if (active_grab) {
+            flush_motion();
             active_grab->button(b, state);
+        }
+    };
+
+    grab_interface->callbacks.keyboard.key = [&](uint32_t key,
+                                                 uint32_t state) {
+        if (active_grab)
+            active_grab->key(key, state);
     };
 
     grab_interface->callbacks.touch.motion = [&](int32_t id, int32_t x,
                                                  int32_t y) {
-        if (active_grab && id == 1)
-            active_grab->pointer_motion(x, y);
+        if (active_grab && id == 1) {
+            pending_motion = {x, y};
+            output->render->schedule_redraw();
+        }
     };
 
+    output->render->add_effect(&on_frame_motion, wf::OUTPUT_EFFECT_PRE);
+
     on_move_activate = [&](auto) {
         if (auto view = wf::get_core().get_cursor_focus_view()) {
-            if (auto vdata = view->get_data<ViewData>()) {
-                if (auto node = vdata->node->find_floating_parent()) {
+            if (auto view_node = view_nodes.find(view)) {
+                if (auto node = view_node->find_floating_parent()) {
                     if (auto active = ActiveMove::construct(this, node)) {
                         active_grab = std::move(active);
                         return true;
@@ -180,8 +269,8 @@ void Swayfire::init_grab_interface() {
 
     on_resize_activate = [&](auto) {
         if (auto view = wf::get_core().get_cursor_focus_view()) {
-            if (auto vdata = view->get_data<ViewData>()) {
-                if (auto node = vdata->node->find_floating_parent()) {
+            if (auto view_node = view_nodes.find(view)) {
+                if (auto node = view_node->find_floating_parent()) {
                     if (auto active = ActiveResize::construct(this, node)) {
                         active_grab = std::move(active);
                         return true;
@@ -194,11 +283,35 @@ void Swayfire::init_grab_interface() {
 
     output->add_button(button_move_activate, &on_move_activate);
     output->add_button(button_resize_activate, &on_resize_activate);
+
+    output->connect_signal(NODE_REMOVED_SIGNAL, &on_node_removed);
 }
 
 void Swayfire::fini_grab_interface() {
+    output->disconnect_signal(&on_node_removed);
     output->rem_binding(&on_resize_activate);
     output->rem_binding(&on_move_activate);
 
+    output->render->rem_effect(&on_frame_motion);
+
     active_grab = nullptr;
+    pending_motion = {};
+}
+
+void Swayfire::drop_grab_of(Node node) {
+    if (active_grab && active_grab->grabs(node)) {
+        active_grab = nullptr;
+        pending_motion = {};
+    }
+}
+
+void Swayfire::flush_motion() {
+    if (!pending_motion)
+        return;
+
+    auto motion = *pending_motion;
+    pending_motion = {};
+
+    if (active_grab)
+        active_grab->pointer_motion(motion.x, motion.y);
 }
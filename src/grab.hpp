@@ -3,6 +3,7 @@
 
 #include <bits/stdint-uintn.h>
 #include <swayfire.hpp>
+#include <wayfire/render-manager.hpp>
 
 /// RAII gesture controller interface.
 class IActiveGrab {
@@ -27,13 +28,21 @@ class IActiveGrab {
     /// Handle the button event.
     virtual void button(uint32_t, uint32_t) {}
 
+    /// Handle the key event.
+    virtual void key(uint32_t, uint32_t) {}
+
+    /// Whether the grab acts on the given node.
+    ///
+    /// The grab is dropped when such a node is removed from its ws.
+    virtual bool grabs(Node) const { return false; }
+
     /// Destroy the active grab and disable the grab interface.
     virtual ~IActiveGrab();
 };
 
 /// RAII button drag gesture controller interface.
 class IActiveButtonDrag : public IActiveGrab {
-  private:
+  protected:
     /// The button that must be unpressed to deactivate the gesture.
     uint32_t deactivate_button;
 
@@ -66,6 +75,10 @@ class ActiveMove : public IActiveButtonDrag {
 
     void pointer_motion(uint32_t x, uint32_t y) override;
 
+    bool grabs(Node node) const override {
+        return node.get() == dragged.get();
+    }
+
     /// Try to activate the grab_interface and begin an move gesture.
     static std::unique_ptr<IActiveGrab>
     construct(nonstd::observer_ptr<Swayfire> plugin, Node dragged);
@@ -86,13 +99,44 @@ class ActiveResize : public IActiveButtonDrag {
     /// The moving edges of the resizing node.
     uint8_t resizing_edges;
 
+    /// Whether the resize is only previewed until the button is released.
+    bool preview = false;
+
+    /// The previewed outer geometry of the resizing node.
+    wf::geometry_t preview_geo;
+
+    /// The preview outline in output coordinates.
+    ///
+    /// Kept so that the outline can be damaged away even after the node is
+    /// gone.
+    wf::geometry_t preview_box{};
+
+    /// Set the previewed geometry and damage the old and new outlines.
+    void set_preview_geo(wf::geometry_t geo);
+
+    /// Render hook drawing the preview outline over the output.
+    wf::effect_hook_t render_preview = [&]() { render_preview_outline(); };
+
+    /// Draw the preview outline over the output.
+    void render_preview_outline();
+
   public:
     ActiveResize(nonstd::observer_ptr<Swayfire> plugin,
                  wf::buttonbinding_t deactivate_butt)
         : IActiveButtonDrag(plugin, deactivate_butt) {}
 
+    ~ActiveResize() override;
+
     void pointer_motion(uint32_t x, uint32_t y) override;
 
+    /// Commit the previewed geometry, if any, with a single configure when
+    /// the button is released.
+    void button(uint32_t b, uint32_t state) override;
+
+    bool grabs(Node node) const override {
+        return node.get() == dragged.get();
+    }
+
     /// Try to activate the grab_interface and begin an resize gesture.
     static std::unique_ptr<IActiveGrab>
     construct(nonstd::observer_ptr<Swayfire> plugin, Node dragged);
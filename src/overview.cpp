@@ -0,0 +1,261 @@
+#include "overview.hpp"
+#include "decoration.hpp"
+#include "swayfire.hpp"
+
+#include <linux/input-event-codes.h>
+#include <wayfire/opengl.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/workspace-manager.hpp>
+
+// Thumbnails
+
+Thumbnails::Thumbnails(OutputRef output) : output(output) {
+    for (auto view : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
+        view->connect_signal("region-damaged", &on_view_damaged);
+
+    output->connect_signal("view-mapped", &on_view_mapped);
+    output->connect_signal("view-disappeared", &on_view_disappeared);
+}
+
+Thumbnails::~Thumbnails() {
+    OpenGL::render_begin();
+    for (auto &[wsid, thumb] : thumbnails) {
+        if (thumb.stream.running)
+            output->render->workspace_stream_stop(thumb.stream);
+        thumb.stream.buffer.release();
+    }
+    OpenGL::render_end();
+}
+
+void Thumbnails::mark_dirty(wayfire_view view) {
+    if (!view || view->get_output() != output.get())
+        return;
+
+    thumbnails[nonwf::get_view_workspace(view, output)].dirty = true;
+
+    if (shown)
+        output->render->schedule_redraw();
+}
+
+std::optional<uint32_t> Thumbnails::refresh(float scale) {
+    auto dims = output->workspace->get_workspace_grid_size();
+    auto now = wf::get_current_time();
+    std::optional<uint32_t> next;
+
+    for (int x = 0; x < dims.width; x++) {
+        for (int y = 0; y < dims.height; y++) {
+            auto &thumb = thumbnails[{x, y}];
+
+            if (!thumb.dirty && thumb.scale == scale)
+                continue;
+
+            // Keep the damage for later instead of rendering the workspace
+            // at every frame of a busy client.
+            auto elapsed = now - thumb.last_refresh;
+            if (thumb.stream.running && thumb.scale == scale &&
+                elapsed < THUMBNAIL_REFRESH_INTERVAL) {
+                auto delay = THUMBNAIL_REFRESH_INTERVAL - elapsed;
+                next = next ? std::min(*next, delay) : delay;
+                continue;
+            }
+
+            if (!thumb.stream.running) {
+                thumb.stream.ws = {x, y};
+                output->render->workspace_stream_start(thumb.stream);
+            }
+
+            output->render->workspace_stream_update(thumb.stream, scale,
+                                                    scale);
+            thumb.dirty = false;
+            thumb.scale = scale;
+            thumb.last_refresh = now;
+        }
+    }
+
+    return next;
+}
+
+wf::texture_t Thumbnails::get_texture(wf::point_t wsid) {
+    return wf::texture_t{thumbnails[wsid].stream.buffer.tex};
+}
+
+// ActiveOverview
+
+#define OVERVIEW_BACKGROUND                                                    \
+    wf::color_t { 0.1, 0.1, 0.1, 1.0 }
+#define OVERVIEW_SELECTION_BORDER 3
+
+ActiveOverview::ActiveOverview(nonstd::observer_ptr<Swayfire> plugin)
+    : IActiveGrab(plugin) {
+    auto size = plugin->output->get_screen_size();
+    grid = plugin->output->workspace->get_workspace_grid_size();
+    selected = plugin->output->workspace->get_current_workspace();
+
+    float sx = (float)(size.width - OVERVIEW_GAP * (grid.width + 1)) /
+               (float)(grid.width * size.width);
+    float sy = (float)(size.height - OVERVIEW_GAP * (grid.height + 1)) /
+               (float)(grid.height * size.height);
+    scale = std::max(std::min(sx, sy), 0.01f);
+
+    // The decorations overlay would draw over the thumbnails at the real
+    // positions of the views.
+    plugin->decorations->set_suspended(true);
+
+    plugin->thumbnails->shown = true;
+    plugin->output->render->set_renderer(renderer);
+    plugin->output->render->schedule_redraw();
+}
+
+ActiveOverview::~ActiveOverview() {
+    refresh_timer.disconnect();
+    plugin->thumbnails->shown = false;
+    plugin->output->render->set_renderer(nullptr);
+    plugin->decorations->set_suspended(false);
+    plugin->output->render->damage_whole();
+}
+
+wf::geometry_t ActiveOverview::get_thumbnail_box(wf::point_t wsid) {
+    auto size = plugin->output->get_screen_size();
+    int tw = (int)((float)size.width * scale);
+    int th = (int)((float)size.height * scale);
+
+    int total_w = grid.width * tw + (grid.width - 1) * OVERVIEW_GAP;
+    int total_h = grid.height * th + (grid.height - 1) * OVERVIEW_GAP;
+
+    return {(size.width - total_w) / 2 + wsid.x * (tw + OVERVIEW_GAP),
+            (size.height - total_h) / 2 + wsid.y * (th + OVERVIEW_GAP), tw,
+            th};
+}
+
+std::optional<wf::point_t> ActiveOverview::get_workspace_at(wf::point_t pos) {
+    for (int x = 0; x < grid.width; x++)
+        for (int y = 0; y < grid.height; y++)
+            if (get_thumbnail_box({x, y}) & pos)
+                return wf::point_t{x, y};
+
+    return {};
+}
+
+void ActiveOverview::select(wf::point_t wsid) {
+    if (wsid == selected)
+        return;
+
+    selected = wsid;
+    plugin->output->render->schedule_redraw();
+}
+
+void ActiveOverview::confirm() {
+    plugin->switch_to_workspace(plugin->workspaces.get(selected));
+    plugin->active_grab = nullptr;
+}
+
+void ActiveOverview::render(const wf::framebuffer_t &fb) {
+    if (auto delay = plugin->thumbnails->refresh(scale)) {
+        if (!refresh_timer.is_connected()) {
+            refresh_timer.set_timeout(*delay, [&]() {
+                plugin->output->render->schedule_redraw();
+                return false;
+            });
+        }
+    }
+
+    auto box = get_thumbnail_box(selected);
+    wf::color_t color = selection_color;
+
+    int b = OVERVIEW_SELECTION_BORDER;
+    wf::geometry_t edges[] = {
+        {box.x - b, box.y - b, box.width + 2 * b, b},
+        {box.x - b, box.y + box.height, box.width + 2 * b, b},
+        {box.x - b, box.y, b, box.height},
+        {box.x + box.width, box.y, b, box.height},
+    };
+
+    OpenGL::render_begin(fb);
+    fb.logic_scissor(fb.geometry);
+    OpenGL::clear(OVERVIEW_BACKGROUND);
+
+    for (int x = 0; x < grid.width; x++)
+        for (int y = 0; y < grid.height; y++)
+            OpenGL::render_texture(plugin->thumbnails->get_texture({x, y}),
+                                   fb, get_thumbnail_box({x, y}));
+
+    for (auto &e : edges)
+        OpenGL::render_rectangle(e, color, fb.get_orthographic_projection());
+
+    OpenGL::render_end();
+}
+
+#undef OVERVIEW_SELECTION_BORDER
+#undef OVERVIEW_BACKGROUND
+
+void ActiveOverview::pointer_motion(uint32_t x, uint32_t y) {
+    auto og = plugin->output->get_layout_geometry();
+    if (auto wsid = get_workspace_at({(int)x - og.x, (int)y - og.y}))
+        select(*wsid);
+}
+
+void ActiveOverview::button(uint32_t button, uint32_t state) {
+    if (button != BTN_LEFT || state != WLR_BUTTON_RELEASED)
+        return;
+
+    auto p = wf::get_core().get_cursor_position();
+    auto og = plugin->output->get_layout_geometry();
+    if (auto wsid = get_workspace_at({(int)p.x - og.x, (int)p.y - og.y})) {
+        selected = *wsid;
+        confirm();
+    }
+}
+
+void ActiveOverview::key(uint32_t key, uint32_t state) {
+    if (state != WL_KEYBOARD_KEY_STATE_PRESSED)
+        return;
+
+    // The bindings are not triggered during the grab, so the toggle key is
+    // handled here to close the overview again.
+    if (key == wf::keybinding_t(plugin->key_toggle_overview).get_key()) {
+        plugin->active_grab = nullptr;
+        return;
+    }
+
+    auto target = selected;
+
+    switch (key) {
+    case KEY_LEFT:
+    case KEY_H:
+        target.x--;
+        break;
+    case KEY_RIGHT:
+    case KEY_L:
+        target.x++;
+        break;
+    case KEY_UP:
+    case KEY_K:
+        target.y--;
+        break;
+    case KEY_DOWN:
+    case KEY_J:
+        target.y++;
+        break;
+    case KEY_ENTER:
+    case KEY_SPACE:
+        confirm();
+        return;
+    case KEY_ESC:
+        plugin->active_grab = nullptr;
+        return;
+    default:
+        return;
+    }
+
+    if (target.x >= 0 && target.x < grid.width && target.y >= 0 &&
+        target.y < grid.height)
+        select(target);
+}
+
+std::unique_ptr<IActiveGrab>
+ActiveOverview::construct(nonstd::observer_ptr<Swayfire> plugin) {
+    return try_activate(
+        plugin, [&]() { return std::make_unique<ActiveOverview>(plugin); });
+}
@@ -0,0 +1,130 @@
+#ifndef OVERVIEW_HPP
+#define OVERVIEW_HPP
+
+#include "grab.hpp"
+#include "swayfire.hpp"
+#include <unordered_map>
+#include <wayfire/workspace-stream.hpp>
+
+/// Minimum time in ms between two refreshes of the same thumbnail.
+#define THUMBNAIL_REFRESH_INTERVAL 100
+
+/// Gap in pixels between the thumbnails of the overview.
+#define OVERVIEW_GAP 20
+
+/// Cached downscaled renders of the workspaces of an output.
+///
+/// A thumbnail is only rendered again once views on its workspace report
+/// damage, and at most every THUMBNAIL_REFRESH_INTERVAL ms. Thumbnails survive
+/// closing the overview so reopening it only refreshes the workspaces that
+/// changed in the meantime.
+class Thumbnails {
+  private:
+    struct Thumbnail {
+        wf::workspace_stream_t stream;
+        bool dirty = true;          ///< Whether the ws changed since rendered.
+        float scale = 0;            ///< The scale rendered at.
+        uint32_t last_refresh = 0;  ///< Time of the last render in ms.
+    };
+
+    /// The output whose workspaces are rendered.
+    OutputRef output;
+
+    /// The thumbnails by wsid.
+    std::unordered_map<wf::point_t, Thumbnail, nonwf::PointHash> thumbnails;
+
+    /// Mark the workspace of a view dirty.
+    void mark_dirty(wayfire_view view);
+
+    wf::signal_connection_t on_view_damaged = [&](wf::signal_data_t *data) {
+        mark_dirty(wf::get_signaled_view(data));
+    };
+
+    /// Track the damage of new views.
+    wf::signal_connection_t on_view_mapped = [&](wf::signal_data_t *data) {
+        auto view = wf::get_signaled_view(data);
+        view->connect_signal("region-damaged", &on_view_damaged);
+        mark_dirty(view);
+    };
+
+    wf::signal_connection_t on_view_disappeared =
+        [&](wf::signal_data_t *data) {
+            mark_dirty(wf::get_signaled_view(data));
+        };
+
+  public:
+    /// Whether the thumbnails are on screen, in which case damage to a
+    /// workspace schedules a new frame.
+    bool shown = false;
+
+    Thumbnails(OutputRef output);
+    ~Thumbnails();
+
+    /// Render the dirty thumbnails at the given scale, unless they were
+    /// rendered too recently.
+    ///
+    /// \return The time in ms until the next held back refresh, if any.
+    std::optional<uint32_t> refresh(float scale);
+
+    /// Get the texture of the thumbnail of a workspace.
+    wf::texture_t get_texture(wf::point_t wsid);
+};
+
+/// Workspace overview showing the thumbnails of all the workspaces.
+///
+/// The selected workspace follows the pointer and the arrow and hjkl keys.
+/// Clicking or pressing enter switches to it, escape closes the overview.
+class ActiveOverview : public IActiveGrab {
+  private:
+    /// The dimensions of the workspace grid.
+    wf::dimensions_t grid;
+
+    /// The selected workspace.
+    wf::point_t selected;
+
+    /// The scale of the thumbnails relative to the output.
+    float scale;
+
+    /// Schedules a frame for the held back thumbnail refreshes.
+    wf::wl_timer refresh_timer;
+
+    /// Color of the border around the selected thumbnail.
+    wf::option_wrapper_t<wf::color_t> selection_color{
+        "swayfire/overview_selection_color"};
+
+    /// Render the overview instead of the current workspace.
+    wf::render_hook_t renderer = [&](const wf::framebuffer_t &fb) {
+        render(fb);
+    };
+
+    /// Get the output geometry of the thumbnail of a workspace.
+    wf::geometry_t get_thumbnail_box(wf::point_t wsid);
+
+    /// Get the workspace whose thumbnail is at the given output position.
+    std::optional<wf::point_t> get_workspace_at(wf::point_t pos);
+
+    /// Select a workspace.
+    void select(wf::point_t wsid);
+
+    /// Switch to the selected workspace and close the overview.
+    void confirm();
+
+    /// Draw the thumbnails and the selection.
+    void render(const wf::framebuffer_t &fb);
+
+  public:
+    ActiveOverview(nonstd::observer_ptr<Swayfire> plugin);
+
+    /// Restore the regular rendering of the output.
+    ~ActiveOverview() override;
+
+    void pointer_motion(uint32_t x, uint32_t y) override;
+    void button(uint32_t button, uint32_t state) override;
+    void key(uint32_t key, uint32_t state) override;
+
+    /// Try to activate the grab_interface and open the overview.
+    static std::unique_ptr<IActiveGrab>
+    construct(nonstd::observer_ptr<Swayfire> plugin);
+};
+
+#endif // ifndef OVERVIEW_HPP
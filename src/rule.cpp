@@ -0,0 +1,217 @@
+#include "rule.hpp"
+#include "command.hpp"
+#include "swayfire.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <wayfire/util/log.hpp>
+
+namespace {
+
+/// Remove a leading keyword followed by a space from a rule source.
+bool strip_keyword(std::string &source, const std::string &keyword) {
+    if (source.compare(0, keyword.size(), keyword) != 0 ||
+        source.size() <= keyword.size() ||
+        !std::isspace((unsigned char)source[keyword.size()]))
+        return false;
+
+    source.erase(0, keyword.size() + 1);
+    return true;
+}
+
+/// Rewrite `[criteria] [→] [workspace] name` as `[criteria] move to
+/// workspace name`.
+///
+/// Only workspaces can be assigned to, other targets like `output HDMI-A-1`
+/// are rejected.
+std::optional<std::string> expand_assign(const std::string &source) {
+    auto close = source.find(']');
+    if (close == std::string::npos)
+        return {};
+
+    auto target = source.substr(close + 1);
+    auto start = target.find_first_not_of(" \t");
+    if (start == std::string::npos)
+        return {};
+    target.erase(0, start);
+
+    if (strip_keyword(target, "→"))
+        target.erase(0, target.find_first_not_of(" \t"));
+
+    if (strip_keyword(target, "output")) {
+        LOGE("Assigning to an output is not supported: ", source);
+        return {};
+    }
+
+    strip_keyword(target, "workspace");
+    target.erase(0, target.find_first_not_of(" \t"));
+    if (target.empty() || target == "workspace")
+        return {};
+
+    // The name must not chain other commands after the move.
+    if (target.find_first_of(";,") != std::string::npos) {
+        LOGE("An assign rule can only name a workspace: ", source);
+        return {};
+    }
+
+    return source.substr(0, close + 1) + " move to workspace " + target;
+}
+
+bool is_rule_action(const Command &command) {
+    switch (command.op) {
+    case CommandOp::FLOATING:
+    case CommandOp::MOVE_TO_WORKSPACE:
+    case CommandOp::RESIZE_SET:
+    case CommandOp::MARK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_exact(const std::optional<Pattern> &pattern) {
+    return pattern && pattern->kind == Pattern::Kind::EXACT;
+}
+
+/// Append the rule indices registered under a key.
+void collect(
+    const std::unordered_map<std::string, std::vector<std::size_t>> &index,
+    const std::string &key, std::vector<std::size_t> &out) {
+    auto found = index.find(key);
+    if (found != index.end())
+        out.insert(out.end(), found->second.begin(), found->second.end());
+}
+
+} // namespace
+
+bool WindowRules::add(const std::string &source) {
+    auto rule_source = source;
+    rule_source.erase(0, rule_source.find_first_not_of(" \t"));
+
+    if (strip_keyword(rule_source, "assign")) {
+        auto expanded = expand_assign(rule_source);
+        if (!expanded) {
+            LOGE("Invalid assign rule: ", source);
+            return false;
+        }
+        rule_source = std::move(*expanded);
+    } else {
+        strip_keyword(rule_source, "for_window");
+    }
+
+    auto chain = parse_command(rule_source);
+    if (!chain)
+        return false;
+
+    if (chain->criteria.size() != 1 ||
+        std::any_of(chain->commands.begin(), chain->commands.end(),
+                    [](const Command &c) { return c.criteria != 0; })) {
+        LOGE("A window rule needs one criteria for all its commands: ",
+             source);
+        return false;
+    }
+
+    // New views have no id, marks or parent yet.
+    auto &criteria = chain->criteria.front();
+    if (criteria.con_id || criteria.con_mark || criteria.floating) {
+        LOGE("Window rules can only match app_id, class, title and "
+             "window_role: ",
+             source);
+        return false;
+    }
+
+    if (!std::all_of(chain->commands.begin(), chain->commands.end(),
+                     is_rule_action)) {
+        LOGE("Window rules can only use floating, move to workspace, "
+             "resize set and mark: ",
+             source);
+        return false;
+    }
+
+    auto id = rules.size();
+    rules.push_back({criteria, chain->commands});
+
+    if (is_exact(criteria.app_id))
+        by_app_id[criteria.app_id->literal].push_back(id);
+    else if (is_exact(criteria.title))
+        by_title[criteria.title->literal].push_back(id);
+    else if (is_exact(criteria.role))
+        by_role[criteria.role->literal].push_back(id);
+    else
+        unindexed.push_back(id);
+
+    return true;
+}
+
+void WindowRules::clear() {
+    rules.clear();
+    by_app_id.clear();
+    by_title.clear();
+    by_role.clear();
+    unindexed.clear();
+}
+
+RuleActions WindowRules::evaluate(ViewNodeRef node) const {
+    RuleActions actions;
+    if (rules.empty())
+        return actions;
+
+    // Each rule is in a single index so the candidates have no duplicates.
+    std::vector<std::size_t> candidates = unindexed;
+    collect(by_app_id, node->view->get_app_id(), candidates);
+    collect(by_title, node->view->get_title(), candidates);
+    if (!by_role.empty())
+        collect(by_role, get_window_role(node->view), candidates);
+
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto id : candidates) {
+        auto &rule = rules[id];
+        if (!rule.criteria.matches(node))
+            continue;
+
+        for (auto &action : rule.actions) {
+            switch (action.op) {
+            case CommandOp::FLOATING:
+                actions.floating =
+                    (CommandToggle)action.arg != CommandToggle::DISABLE;
+                break;
+
+            case CommandOp::MOVE_TO_WORKSPACE:
+                actions.workspace = action.name;
+                break;
+
+            case CommandOp::RESIZE_SET:
+                actions.size = {action.arg, action.arg2};
+                break;
+
+            case CommandOp::MARK:
+                if (!action.arg)
+                    actions.marks.clear();
+                actions.marks.erase(std::remove(actions.marks.begin(),
+                                                actions.marks.end(),
+                                                action.name),
+                                    actions.marks.end());
+                actions.marks.push_back(action.name);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    return actions;
+}
+
+// Swayfire
+
+void Swayfire::load_window_rules() {
+    rule_index->clear();
+
+    wf::config::compound_list_t<std::string> rules = window_rules;
+
+    for (auto &[name, source] : rules)
+        if (!rule_index->add(source))
+            LOGE("Ignoring window rule ", name);
+}
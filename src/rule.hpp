@@ -0,0 +1,70 @@
+#ifndef RULE_HPP
+#define RULE_HPP
+
+#include "command.hpp"
+#include "swayfire.hpp"
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// The combined effect of the window rules matching a new view.
+///
+/// Rules are applied before the node of the view is inserted so that they
+/// are laid out along with the insertion.
+struct RuleActions {
+    std::optional<bool> floating;         ///< Whether to insert it floating.
+    std::optional<std::string> workspace; ///< Name of the ws to insert it in.
+    std::optional<wf::dimensions_t> size; ///< Floating size, 0 keeps a side.
+    std::vector<std::string> marks;       ///< The marks to give it.
+};
+
+/// A compiled window rule.
+struct WindowRule {
+    Criteria criteria;
+    std::vector<Command> actions;
+};
+
+/// The window rules applied to new views, like sway's `for_window` and
+/// `assign`.
+///
+/// Rules with an exact app_id, title or window role, like `app_id="^foot$"`,
+/// are indexed by that value so that matching a view only checks the rules
+/// sharing one of its fields and the rules which could not be indexed.
+class WindowRules {
+  private:
+    /// The rules in config order.
+    std::vector<WindowRule> rules;
+
+    /// The rules indexed by their exact app_id.
+    std::unordered_map<std::string, std::vector<std::size_t>> by_app_id;
+
+    /// The rules without an exact app_id indexed by their exact title.
+    std::unordered_map<std::string, std::vector<std::size_t>> by_title;
+
+    /// The rules without an exact app_id or title indexed by their exact
+    /// window role.
+    std::unordered_map<std::string, std::vector<std::size_t>> by_role;
+
+    /// The rules checked for every view.
+    std::vector<std::size_t> unindexed;
+
+  public:
+    /// Compile and index a rule.
+    ///
+    /// A rule is either `for_window [criteria] commands`, `[criteria]
+    /// commands` or `assign [criteria] [→] workspace`. Only the floating,
+    /// move to workspace, resize set and mark commands are allowed. Returns
+    /// false and logs the error if the rule is invalid.
+    bool add(const std::string &source);
+
+    /// Remove all the rules.
+    void clear();
+
+    /// Get the combined actions of the rules matching a new view node.
+    ///
+    /// Later rules override earlier ones.
+    RuleActions evaluate(ViewNodeRef node) const;
+};
+
+#endif // ifndef RULE_HPP
@@ -1,14 +1,21 @@
 #include "swayfire.hpp"
+#include "decoration.hpp"
 #include "grab.hpp"
+#include "overview.hpp"
+#include "rule.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <iterator>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <utility>
 #include <wayfire/config/types.hpp>
 #include <wayfire/core.hpp>
 #include <wayfire/geometry.hpp>
+#include <wayfire/render-manager.hpp>
 #include <wayfire/util/log.hpp>
 #include <wlr/util/edges.h>
 
@@ -32,19 +39,6 @@ wf::point_t nonwf::get_view_workspace(wayfire_view view, OutputRef output) {
     return {x, y};
 }
 
-wf::geometry_t nonwf::local_to_relative_geometry(wf::geometry_t geo,
-                                                 wf::point_t from_wsid,
-                                                 wf::point_t to_wsid,
-                                                 OutputRef output) {
-
-    auto og = output->get_screen_size();
-
-    geo.x += og.width * (from_wsid.x - to_wsid.x);
-    geo.y += og.height * (from_wsid.y - to_wsid.y);
-
-    return geo;
-}
-
 wf::point_t nonwf::geometry_center(wf::geometry_t geo) {
     return {
         (int)std::floor((float)(geo.x + geo.width) / 2.0f),
@@ -65,33 +59,40 @@ SplitNodeRef INode::as_split_node() { return dynamic_cast<SplitNode *>(this); }
 ViewNodeRef INode::as_view_node() { return dynamic_cast<ViewNode *>(this); }
 
 void INode::try_resize(wf::dimensions_t ndims, uint32_t edges) {
-    if (get_floating()) {
-        auto ngeo = get_geometry();
+    if (get_floating())
+        set_geometry(calc_resize(ndims, edges));
+}
 
-        auto hori_locked = (edges & (WLR_EDGE_LEFT | WLR_EDGE_RIGHT)) == 0;
-        auto vert_locked = (edges & (WLR_EDGE_TOP | WLR_EDGE_BOTTOM)) == 0;
+wf::geometry_t INode::calc_resize(wf::dimensions_t ndims, uint32_t edges) {
+    auto ngeo = get_geometry();
 
-        if (!hori_locked) {
-            if (edges & WLR_EDGE_LEFT) {
-                int dw = ndims.width - ngeo.width;
-                ngeo.x -= dw;
-            }
-            ngeo.width = ndims.width;
-        }
+    auto hori_locked = (edges & (WLR_EDGE_LEFT | WLR_EDGE_RIGHT)) == 0;
+    auto vert_locked = (edges & (WLR_EDGE_TOP | WLR_EDGE_BOTTOM)) == 0;
 
-        if (!vert_locked) {
-            if (edges & WLR_EDGE_TOP) {
-                int dh = ndims.height - ngeo.height;
-                ngeo.y -= dh;
-            }
-            ngeo.height = ndims.height;
+    if (!hori_locked) {
+        if (edges & WLR_EDGE_LEFT) {
+            int dw = ndims.width - ngeo.width;
+            ngeo.x -= dw;
         }
+        ngeo.width = ndims.width;
+    }
 
-        set_geometry(ngeo);
+    if (!vert_locked) {
+        if (edges & WLR_EDGE_TOP) {
+            int dh = ndims.height - ngeo.height;
+            ngeo.y -= dh;
+        }
+        ngeo.height = ndims.height;
     }
+
+    return ngeo;
 }
 
 void INode::set_active() {
+    // Nodes outside of any ws (i.e. in the scratchpad) can't be active.
+    if (!ws)
+        return;
+
     parent->set_active_child(this);
     ws->set_active_node(this);
 }
@@ -100,6 +101,10 @@ Node INode::find_floating_parent() {
     if (get_floating())
         return this;
 
+    // Nodes being moved around have no parent for a moment.
+    if (!parent)
+        return nullptr;
+
     if (auto p = parent->as_split_node())
         return p->find_floating_parent();
 
@@ -109,13 +114,7 @@ Node INode::find_floating_parent() {
 // ViewGeoEnforcer
 
 ViewGeoEnforcer::ViewGeoEnforcer(ViewNodeRef node)
-    : wf::view_2D(node->view), view_node(node) {
-    view->connect_signal("geometry-changed", &on_geometry_changed);
-}
-
-ViewGeoEnforcer::~ViewGeoEnforcer() {
-    view->disconnect_signal(&on_geometry_changed);
-}
+    : wf::view_2D(node->view), view_node(node) {}
 
 void ViewGeoEnforcer::update_transformer() {
     auto curr = view->get_wm_geometry();
@@ -123,70 +122,119 @@ void ViewGeoEnforcer::update_transformer() {
     if (curr.width <= 0 && curr.height <= 0)
         return;
 
-    auto geo = view_node->get_geometry();
-
-    auto output = view_node->ws->output;
-    auto wsid = view_node->ws->wsid;
-    auto curr_wsid = output->workspace->get_current_workspace();
-    if (wsid != curr_wsid)
-        geo = nonwf::local_to_relative_geometry(geo, wsid, curr_wsid, output);
-
-    if (curr == geo) {
-        scale_x = 1;
-        scale_y = 1;
-        translation_x = 0;
-        translation_y = 0;
-        view->damage();
+    // Scratchpad nodes are hidden and have no geometry to enforce.
+    if (!view_node->ws)
         return;
+
+    auto geo = view_node->get_target_view_geometry();
+
+    float nscale_x = 1;
+    float nscale_y = 1;
+    float ntranslation_x = 0;
+    float ntranslation_y = 0;
+
+    if (curr != geo) {
+        nscale_x = (float)geo.width / (float)curr.width;
+        nscale_y = (float)geo.height / (float)curr.height;
+
+        ntranslation_x = (float)geo.x - (float)curr.x +
+                         ((float)geo.width - (float)curr.width) / 2.0f;
+        ntranslation_y = (float)geo.y - (float)curr.y +
+                         ((float)geo.height - (float)curr.height) / 2.0f;
     }
 
-    scale_x = (float)geo.width / (float)curr.width;
-    scale_y = (float)geo.height / (float)curr.height;
+    // Switching workspaces moves the view and the ws offset by the same
+    // amount so the transform is unchanged and there is nothing to redo.
+    if (nscale_x == scale_x && nscale_y == scale_y &&
+        ntranslation_x == translation_x && ntranslation_y == translation_y)
+        return;
+
+    // Only the area left by the old transform and covered by the new one
+    // needs repainting.
+    wf::region_t damage{view->get_bounding_box()};
 
-    translation_x = (float)geo.x - (float)curr.x +
-                    ((float)geo.width - (float)curr.width) / 2.0f;
-    translation_y = (float)geo.y - (float)curr.y +
-                    ((float)geo.height - (float)curr.height) / 2.0f;
+    scale_x = nscale_x;
+    scale_y = nscale_y;
+    translation_x = ntranslation_x;
+    translation_y = ntranslation_y;
 
-    view->damage();
+    damage |= view->get_bounding_box();
+    view_node->ws->output->render->damage(damage);
 }
 
 // ViewNode
 
-ViewNode::ViewNode(wayfire_view view) : view(view) {
-    auto ge = std::make_unique<ViewGeoEnforcer>(this);
-    geo_enforcer = ge.get();
-    view->add_transformer(std::move(ge));
-
-    geometry = view->get_wm_geometry();
+ViewNode::ViewNode(wayfire_view view,
+                   nonstd::observer_ptr<ViewNodeIndex> index, WorkspaceRef ws)
+    : index(index), view(view), title(view->get_title()) {
+    this->ws = ws;
+    geometry = to_outer_geometry(view->get_wm_geometry());
     floating_geometry = geometry;
 
+    index->insert(this);
+
+    view->connect_signal("geometry-changed", &on_geometry_changed);
     view->connect_signal("mapped", &on_mapped);
     view->connect_signal("unmapped", &on_unmapped);
-    view->get_output()->connect_signal("view-focused", &on_focused);
 }
 
 ViewNode::~ViewNode() {
     LOGD("Destroying ", this);
 
-    view->get_output()->disconnect_signal(&on_focused);
+    if (hide_reasons)
+        view->set_visible(true);
+
     view->disconnect_signal(&on_unmapped);
     view->disconnect_signal(&on_mapped);
+    view->disconnect_signal(&on_geometry_changed);
 
-    view->pop_transformer(geo_enforcer);
+    stop_animation();
 
-    view->erase_data<ViewData>();
+    if (geo_enforcer)
+        view->pop_transformer(geo_enforcer);
+
+    index->erase(this);
+}
+
+void ViewNode::on_mapped_impl() {
+    if (view->tiled_edges != wf::TILED_EDGES_ALL)
+        floating_geometry = to_outer_geometry(view->get_wm_geometry());
+
+    if (ws)
+        ws->request_occlusion_update();
 }
 
 void ViewNode::on_unmapped_impl() {
     // ws might get unset on remove_child so we must save it.
     auto ws = this->ws;
+    if (ws)
+        ws->defer_layout_until_idle();
+
     parent->remove_child(this);
-    ws->node_removed(this);
+    if (ws)
+        ws->node_removed(this);
 
     // view node dies here.
 }
 
+void ViewNode::set_hidden(HideReason reason, bool hidden) {
+    bool was_hidden = hide_reasons;
+
+    if (hidden)
+        hide_reasons |= (uint8_t)reason;
+    else
+        hide_reasons &= ~(uint8_t)reason;
+
+    if (was_hidden == (bool)hide_reasons)
+        return;
+
+    // The border appears and disappears along with the view.
+    if (ws)
+        ws->damage_decorations(get_border_region(), this);
+
+    view->set_visible(!hide_reasons);
+}
+
 void ViewNode::set_floating(bool fl) {
     if (!floating && fl)
         set_geometry(floating_geometry);
@@ -196,20 +244,282 @@ void ViewNode::set_floating(bool fl) {
 
     floating = fl;
     view->set_tiled(fl ? 0 : wf::TILED_EDGES_ALL);
+
+    if (ws)
+        ws->corners_changed(this);
 }
 
 void ViewNode::set_geometry(wf::geometry_t geo) {
+    // Fullscreen views are out of the layout until they leave fullscreen.
+    if (fullscreen) {
+        geometry = geo;
+        layout_configure();
+        return;
+    }
+
+    auto from = get_display_geometry();
+    damage_border();
     geometry = geo;
 
-    auto curr_wsid = ws->output->workspace->get_current_workspace();
-    if (ws->wsid != curr_wsid)
-        geo = nonwf::local_to_relative_geometry(geo, ws->wsid, curr_wsid,
-                                                ws->output);
+    // Only tiled layout changes on the current ws are animated, floating
+    // nodes follow interactive moves and resizes directly.
+    bool animate = (int)ws->animation_duration > 0 && from != geo &&
+                   view->is_mapped() && !hide_reasons &&
+                   !find_floating_parent() &&
+                   ws->wsid == ws->output->workspace->get_current_workspace();
+
+    if (animate)
+        start_animation(from);
+    else
+        stop_animation();
+
+    // Moves are handled by the compositor alone, only resizes need the
+    // client's cooperation.
+    auto ogeo = ws->to_output_geometry(to_view_geometry(geo));
+    moving = true;
+    view->move(ogeo.x, ogeo.y);
+    moving = false;
+    layout_configure();
+
+    update_geo_enforcer();
+    damage_border();
+
+    ws->request_occlusion_update();
+}
+
+void ViewNode::layout_configure() {
+    // A deferred layout configures every view of the ws once on commit.
+    if (ws && ws->try_defer_layout())
+        return;
+
+    configure();
+}
+
+void ViewNode::configure() {
+    auto inner =
+        fullscreen ? get_fullscreen_geometry() : to_view_geometry(geometry);
+    wf::dimensions_t size = {inner.width, inner.height};
+
+    if (configure_in_flight) {
+        configure_pending = true;
+        return;
+    }
+
+    auto curr = view->get_wm_geometry();
+    if (curr.width == size.width && curr.height == size.height)
+        return;
+
+    configure_base = {curr.width, curr.height};
+    configure_in_flight = size;
+    configure_pending = false;
+
+    view->resize(size.width, size.height);
+
+    configure_timeout.set_timeout(CONFIGURE_TIMEOUT, [&]() {
+        LOGD("configure timed out for ", this);
+        configure_acked();
+        return false;
+    });
+}
+
+void ViewNode::check_configure_acked() {
+    if (!configure_in_flight) {
+        if (!ws)
+            return;
+
+        if (!floating || fullscreen) {
+            // The client resized on its own or late, so bring it back in
+            // line.
+            configure();
+            return;
+        }
+
+        // Floating clients are free to pick their own size.
+        auto curr = view->get_wm_geometry();
+        auto inner = to_view_geometry(geometry);
+        if (curr.width == inner.width && curr.height == inner.height)
+            return;
+
+        damage_border();
+        geometry.width += curr.width - inner.width;
+        geometry.height += curr.height - inner.height;
+        floating_geometry = geometry;
+        damage_border();
+
+        ws->request_occlusion_update();
+        return;
+    }
+
+    // The client either accepted the requested size or picked another one.
+    auto curr = view->get_wm_geometry();
+    wf::dimensions_t size = {curr.width, curr.height};
+    if (size == *configure_in_flight || size != configure_base)
+        configure_acked();
+}
+
+void ViewNode::configure_acked() {
+    configure_in_flight = {};
+    configure_timeout.disconnect();
+
+    if (configure_pending) {
+        configure_pending = false;
+        configure();
+        update_geo_enforcer();
+    }
+}
+
+void ViewNode::update_geo_enforcer() {
+    // Scratchpad nodes are hidden and have no geometry to enforce.
+    if (!ws)
+        return;
+
+    auto curr = view->get_wm_geometry();
+    if (curr.width <= 0 && curr.height <= 0)
+        return;
+
+    // Any transformer rules out direct scanout of fullscreen views, so they
+    // are shown at whatever size the client committed.
+    if (curr == get_target_view_geometry() || fullscreen) {
+        if (geo_enforcer) {
+            view->pop_transformer(geo_enforcer);
+            geo_enforcer = nullptr;
+        }
+        return;
+    }
+
+    if (!geo_enforcer) {
+        auto ge = std::make_unique<ViewGeoEnforcer>(this);
+        geo_enforcer = ge.get();
+        view->add_transformer(std::move(ge));
+    }
 
-    view->set_geometry(geo);
     geo_enforcer->update_transformer();
 }
 
+wf::geometry_t ViewNode::get_display_geometry() {
+    if (!animation_ws)
+        return geometry;
+
+    auto progress = animation_ws->get_animation_progress();
+    auto step = [&](int from, int to) {
+        return from + (int)std::round((to - from) * progress);
+    };
+
+    return {step(animation_from.x, geometry.x),
+            step(animation_from.y, geometry.y),
+            step(animation_from.width, geometry.width),
+            step(animation_from.height, geometry.height)};
+}
+
+int ViewNode::get_title_height() {
+    if (parent)
+        if (auto split = parent->as_split_node())
+            if (split->is_tabbed())
+                return 0;
+
+    return ws ? std::max(0, (int)ws->title_height) : 0;
+}
+
+wf::geometry_t ViewNode::to_view_geometry(wf::geometry_t outer) {
+    int bw = ws ? std::max(0, (int)ws->border_width) : 0;
+    int th = get_title_height();
+    return {outer.x + bw, outer.y + bw + th, std::max(1, outer.width - 2 * bw),
+            std::max(1, outer.height - 2 * bw - th)};
+}
+
+wf::geometry_t ViewNode::to_outer_geometry(wf::geometry_t inner) {
+    int bw = ws ? std::max(0, (int)ws->border_width) : 0;
+    int th = get_title_height();
+    return {inner.x - bw, inner.y - bw - th, inner.width + 2 * bw,
+            inner.height + 2 * bw + th};
+}
+
+wf::geometry_t ViewNode::get_fullscreen_geometry() {
+    auto size = ws->output->get_screen_size();
+    return {0, 0, size.width, size.height};
+}
+
+wf::geometry_t ViewNode::get_target_view_geometry() {
+    if (fullscreen)
+        return ws->to_output_geometry(get_fullscreen_geometry());
+
+    return ws->to_output_geometry(to_view_geometry(get_display_geometry()));
+}
+
+wf::region_t ViewNode::get_border_region() {
+    if (!ws || fullscreen)
+        return {};
+
+    auto outer = ws->to_output_geometry(get_display_geometry());
+    return wf::region_t{outer} ^ get_target_view_geometry();
+}
+
+std::optional<wf::geometry_t> ViewNode::get_title_geometry() {
+    int th = get_title_height();
+    if (!ws || fullscreen || th <= 0)
+        return {};
+
+    int bw = ws ? std::max(0, (int)ws->border_width) : 0;
+    auto outer = ws->to_output_geometry(get_display_geometry());
+    if (outer.width <= 2 * bw)
+        return {};
+
+    return wf::geometry_t{outer.x + bw, outer.y + bw, outer.width - 2 * bw, th};
+}
+
+void ViewNode::damage_border() {
+    if (!ws || hide_reasons)
+        return;
+
+    ws->damage_decorations(get_border_region(), this);
+}
+
+void ViewNode::start_animation(wf::geometry_t from) {
+    if (animation_ws.get() != ws.get())
+        stop_animation();
+
+    ws->animate_node(this, from);
+}
+
+void ViewNode::stop_animation() {
+    if (animation_ws)
+        animation_ws->stop_animating(this);
+}
+
+void ViewNode::set_fullscreen(bool fs) {
+    if (fs == fullscreen || !ws)
+        return;
+
+    if (fs && ws->fullscreen_node)
+        ws->fullscreen_node->set_fullscreen(false);
+
+    damage_border();
+    fullscreen = fs;
+    ws->fullscreen_node = fs ? this : nullptr;
+    view->set_fullscreen(fs);
+
+    // Fullscreen views are shown unclipped.
+    ws->corners_changed(this);
+
+    if (fs) {
+        stop_animation();
+
+        auto ogeo = get_target_view_geometry();
+        moving = true;
+        view->move(ogeo.x, ogeo.y);
+        moving = false;
+        layout_configure();
+        update_geo_enforcer();
+
+        ws->output->workspace->bring_to_front(view);
+    } else {
+        // Go back to the slot the layout kept for this node.
+        set_geometry(geometry);
+    }
+
+    ws->request_occlusion_update();
+}
+
 SplitNodeRef ViewNode::try_upgrade() {
     if (prefered_split_type) {
         auto new_parent = std::make_unique<SplitNode>(get_geometry());
@@ -226,10 +536,20 @@ SplitNodeRef ViewNode::try_upgrade() {
 }
 
 void ViewNode::set_active() {
+    if (!ws)
+        return;
+
     INode::set_active();
 
-    if (!view->activated)
+    // Focusing raises the view which changes the stacking order.
+    ws->request_occlusion_update();
+
+    // The tree is already up to date, only the view's focus is missing.
+    if (!view->activated) {
+        requesting_focus = true;
         view->focus_request();
+        requesting_focus = false;
+    }
 }
 
 NodeParent ViewNode::get_or_upgrade_to_parent_node() {
@@ -256,8 +576,15 @@ void SplitNode::insert_child_at(SplitChildIter at, OwnedNode node) {
     nchild.node = std::move(node);
     nchild.ratio = 1.0f - total_ratio;
 
+    auto node_ref = nchild.node.get();
     children.insert(at, std::move(nchild));
-    refresh_geometry();
+    if (!ws || !ws->try_defer_layout())
+        refresh_geometry();
+    update_tabs();
+
+    // The node may have moved in or out of a floating split.
+    if (ws)
+        ws->corners_changed(node_ref);
 }
 
 void SplitNode::insert_child_front(OwnedNode node) {
@@ -319,9 +646,12 @@ OwnedNode SplitNode::remove_child_at(SplitChildIter child) {
         children.back().ratio = 1.0f - total_ratio;
     }
 
-    refresh_geometry();
+    if (!ws || !ws->try_defer_layout())
+        refresh_geometry();
+    update_tabs();
 
     owned_node->parent = nullptr;
+    owned_node->set_hidden(HideReason::INACTIVE_TAB, false);
 
     return owned_node;
 }
@@ -333,18 +663,109 @@ void SplitNode::set_active_child(Node node) {
         return;
     }
 
-    active_child = std::distance(children.begin(), child);
+    uint32_t nactive = std::distance(children.begin(), child);
+    if (nactive != active_child) {
+        active_child = nactive;
+        update_tabs();
+    }
 
     parent->set_active_child(this);
 }
 
+void SplitNode::update_tabs() {
+    for (uint32_t i = 0; i < children.size(); i++)
+        children[i].node->set_hidden(HideReason::INACTIVE_TAB,
+                                     tab_hidden ||
+                                         (is_tabbed() && i != active_child));
+
+    invalidate_header();
+}
+
+int SplitNode::get_header_height() {
+    int th = ws ? std::max(0, (int)ws->title_height) : 0;
+
+    switch (split_type) {
+    case SplitType::TABBED:
+        return th;
+    case SplitType::STACKED:
+        return th * (int)children.size();
+    case SplitType::VSPLIT:
+    case SplitType::HSPLIT:
+        return 0;
+    }
+
+    return 0;
+}
+
+std::optional<wf::geometry_t> SplitNode::get_header_geometry() {
+    int height = std::min(get_header_height(), geometry.height);
+    if (!ws || height <= 0 || children.empty())
+        return {};
+
+    return ws->to_output_geometry(
+        {geometry.x, geometry.y, geometry.width, height});
+}
+
+void SplitNode::damage_header() {
+    if (auto header = get_header_geometry())
+        ws->damage_decorations(*header);
+}
+
+void SplitNode::invalidate_header() {
+    if (!is_tabbed())
+        return;
+
+    header_version++;
+    damage_header();
+}
+
+void SplitNode::set_split_type(SplitType type) {
+    damage_header();
+    split_type = type;
+
+    // The title bars of the children move into or out of the header.
+    if (!ws || !ws->try_defer_layout())
+        refresh_geometry();
+    update_tabs();
+}
+
 void SplitNode::toggle_split_direction() {
     LOGD("Toggling split dir: ", parent);
 
-    split_type = (split_type == SplitType::HSPLIT) ? SplitType::VSPLIT
-                                                   : SplitType::HSPLIT;
+    set_split_type((split_type == SplitType::HSPLIT) ? SplitType::VSPLIT
+                                                     : SplitType::HSPLIT);
+}
+
+bool SplitNode::resize_child(Node node, int delta) {
+    auto child = find_child(node);
+    if (child == children.end() || children.size() < 2 || is_tabbed())
+        return false;
+
+    int total = split_type == SplitType::VSPLIT ? geometry.width
+                                                : geometry.height;
+    if (total <= 0)
+        return false;
+
+    // Keep every sibling at least MIN_VIEW_SIZE wide.
+    float min_ratio = (float)MIN_VIEW_SIZE / (float)total;
+    float max_ratio = 1.0f - min_ratio * (float)(children.size() - 1);
+    if (max_ratio < min_ratio)
+        return false;
 
-    refresh_geometry();
+    float nratio = std::clamp(child->ratio + (float)delta / (float)total,
+                              min_ratio, max_ratio);
+    float others = 1.0f - child->ratio;
+    if (nratio == child->ratio || others <= 0.0f)
+        return false;
+
+    float scale = (1.0f - nratio) / others;
+    for (auto &c : children)
+        c.ratio *= scale;
+    child->ratio = nratio;
+
+    if (!ws || !ws->try_defer_layout())
+        refresh_geometry();
+    return true;
 }
 
 Node SplitNode::try_downgrade() {
@@ -361,6 +782,21 @@ Node SplitNode::try_downgrade() {
     return nullptr;
 }
 
+void SplitNode::remove_empty_splits() {
+    for (std::size_t i = 0; i < children.size();) {
+        if (auto split = children[i].node->as_split_node()) {
+            split->remove_empty_splits();
+
+            if (split->children.empty()) {
+                auto owned = remove_child_at(children.begin() + i);
+                ws->node_removed(owned.get());
+                continue;
+            }
+        }
+        i++;
+    }
+}
+
 NodeParent SplitNode::get_or_upgrade_to_parent_node() { return this; }
 
 OwnedNode SplitNode::swap_child(Node node, OwnedNode other) {
@@ -368,11 +804,14 @@ OwnedNode SplitNode::swap_child(Node node, OwnedNode other) {
     if (child == children.end())
         LOGE("Node ", node, " not found in split node: ", this);
 
-    other->set_geometry(child->node->get_geometry());
     other->parent = this;
+    other->set_ws(ws);
+    other->set_geometry(child->node->get_geometry());
 
     child->node.swap(other);
+    update_tabs();
 
+    other->set_hidden(HideReason::INACTIVE_TAB, false);
     return other;
 }
 
@@ -581,7 +1020,12 @@ bool SplitNode::move_child(Node node, Direction dir) {
 #undef MOVE_BACK
 }
 
-void SplitNode::set_floating(bool fl) { floating = fl; }
+void SplitNode::set_floating(bool fl) {
+    floating = fl;
+
+    if (ws)
+        ws->corners_changed(this);
+}
 
 void SplitNode::set_ws(WorkspaceRef ws) {
     INode::set_ws(ws);
@@ -590,7 +1034,25 @@ void SplitNode::set_ws(WorkspaceRef ws) {
         child.node->set_ws(ws);
 }
 
+void SplitNode::set_hidden(HideReason reason, bool hidden) {
+    // Inactive tabs of this split must stay hidden when this split is shown.
+    if (reason == HideReason::INACTIVE_TAB) {
+        tab_hidden = hidden;
+        update_tabs();
+        return;
+    }
+
+    for (auto &child : children)
+        child.node->set_hidden(reason, hidden);
+}
+
 void SplitNode::set_geometry(wf::geometry_t geo) {
+    damage_header();
+
+    // Floating splits cast their shadow around their whole geometry.
+    if (ws && floating)
+        ws->damage_decorations({}, this);
+
     switch (split_type) {
 // distribute over dim1 and pos1
 #define DISTRIBUTE(dim1, dim2, pos1, pos2)                                     \
@@ -622,32 +1084,52 @@ void SplitNode::set_geometry(wf::geometry_t geo) {
         DISTRIBUTE(height, width, y, x);
         break;
 #undef DISTRIBUTE
-    case SplitType::TABBED: {
-        for (auto &child : children)
-            child.node->set_geometry(geo);
-        break;
-    }
+    case SplitType::TABBED:
     case SplitType::STACKED: {
+        // Children are stacked on top of each other under the header.
+        int header = std::min(get_header_height(), geo.height - 1);
+        auto subgeo = geo;
+        subgeo.y += header;
+        subgeo.height -= header;
+
         for (auto &child : children)
-            child.node->set_geometry(geo);
+            child.node->set_geometry(subgeo);
         break;
     }
     }
     geometry = geo;
+
+    damage_header();
+
+    if (ws && floating)
+        ws->damage_decorations({}, this);
 }
 
 // Workspace
 
-Workspace::Workspace(wf::point_t wsid, wf::geometry_t geo, OutputRef output)
-    : workarea(geo), wsid(wsid), output(output) {
+Workspace::Workspace(wf::point_t wsid, wf::geometry_t geo, OutputRef output,
+                     nonstd::observer_ptr<ViewNodeIndex> view_nodes)
+    : workarea(geo), wsid(wsid), output(output), view_nodes(view_nodes) {
     (void)swap_tiled_root(std::make_unique<SplitNode>(geo));
     LOGD("ws created with root ", tiled_root->to_string());
     active_node = tiled_root;
 
     output->connect_signal("workarea-changed", &on_workarea_changed);
+
+    // The decorations are part of the outer geometry of the nodes.
+    border_width.set_callback([&]() { refresh_layout(); });
+    title_height.set_callback([&]() { refresh_layout(); });
+    corner_radius.set_callback([&]() { request_occlusion_update(); });
 }
 
-Workspace::~Workspace() { output->disconnect_signal(&on_workarea_changed); }
+Workspace::~Workspace() {
+    output->disconnect_signal(&on_workarea_changed);
+
+    for (auto &node : animated_nodes)
+        node->animation_ws = nullptr;
+    if (!animated_nodes.empty())
+        output->render->rem_effect(&on_animation_frame);
+}
 
 void Workspace::set_active_node(Node node) {
     if (!node->get_floating())
@@ -659,10 +1141,12 @@ void Workspace::set_active_node(Node node) {
 Node Workspace::get_active_node() { return active_node; }
 
 void Workspace::insert_floating_node(OwnedNode node) {
-    node->set_floating(true);
     node->set_ws(this);
+    node->set_floating(true);
     node->parent = this;
     floating_nodes.push_back(std::move(node));
+
+    request_occlusion_update();
 }
 
 NodeIter Workspace::find_floating(Node node) {
@@ -697,6 +1181,7 @@ OwnedNode Workspace::remove_floating_node(Node node) {
 
     owned_node->set_floating(false);
 
+    request_occlusion_update();
     return owned_node;
 }
 
@@ -769,6 +1254,21 @@ void Workspace::node_removed(Node node) {
 
     if (node.get() == active_node.get())
         active_node = active_tiled_node;
+
+    if (node.get() == fullscreen_node.get())
+        fullscreen_node = nullptr;
+
+    request_occlusion_update();
+
+    NodeRemovedSignal data;
+    data.node = node;
+    output->emit_signal(NODE_REMOVED_SIGNAL, &data);
+}
+
+void Workspace::corners_changed(Node node) {
+    CornersChangedSignal data;
+    data.node = node;
+    output->emit_signal(CORNERS_CHANGED_SIGNAL, &data);
 }
 
 void Workspace::insert_child(OwnedNode node) {
@@ -831,6 +1331,98 @@ void Workspace::set_active_child(Node node) {
     }
 }
 
+wf::point_t Workspace::get_output_offset() {
+    auto og = output->get_screen_size();
+    auto curr_wsid = output->workspace->get_current_workspace();
+
+    return {
+        og.width * (wsid.x - curr_wsid.x),
+        og.height * (wsid.y - curr_wsid.y),
+    };
+}
+
+wf::geometry_t Workspace::to_output_geometry(wf::geometry_t geo) {
+    auto offset = get_output_offset();
+
+    geo.x += offset.x;
+    geo.y += offset.y;
+
+    return geo;
+}
+
+void Workspace::damage_decorations(const wf::region_t &region, Node node) {
+    if (region.empty() && !node)
+        return;
+
+    output->render->damage(region);
+
+    DecorationsDamagedSignal data;
+    data.node = node;
+    output->emit_signal(DECORATIONS_DAMAGED_SIGNAL, &data);
+}
+
+void Workspace::animate_node(ViewNodeRef node, wf::geometry_t from) {
+    // A later layout change restarts the animation, the nodes still moving
+    // go on from where they are displayed.
+    if (!animation_started) {
+        for (auto &animated : animated_nodes)
+            animated->animation_from = animated->get_display_geometry();
+
+        layout_animation.start();
+        animation_started = true;
+    }
+
+    if (animated_nodes.empty())
+        output->render->add_effect(&on_animation_frame,
+                                   wf::OUTPUT_EFFECT_PRE);
+
+    if (!node->animation_ws)
+        animated_nodes.push_back(node);
+
+    node->animation_from = from;
+    node->animation_ws = this;
+
+    output->render->schedule_redraw();
+}
+
+void Workspace::stop_animating(ViewNodeRef node) {
+    auto found = std::find(animated_nodes.begin(), animated_nodes.end(), node);
+    if (found == animated_nodes.end())
+        return;
+
+    animated_nodes.erase(found);
+    node->animation_ws = nullptr;
+
+    if (animated_nodes.empty())
+        output->render->rem_effect(&on_animation_frame);
+}
+
+void Workspace::animation_frame() {
+    animation_started = false;
+
+    auto nodes = animated_nodes;
+    for (auto &node : nodes)
+        node->damage_border();
+
+    bool running = layout_animation.running();
+    if (!running) {
+        for (auto &node : nodes)
+            node->animation_ws = nullptr;
+        animated_nodes.clear();
+        output->render->rem_effect(&on_animation_frame);
+    }
+
+    // Views whose client has not committed its final size yet keep their
+    // geo enforcer until it does.
+    for (auto &node : nodes) {
+        node->update_geo_enforcer();
+        node->damage_border();
+    }
+
+    if (running)
+        output->render->schedule_redraw();
+}
+
 void Workspace::set_workarea(wf::geometry_t geo) {
     workarea = geo;
     tiled_root->set_geometry(geo);
@@ -853,6 +1445,107 @@ void Workspace::set_workarea(wf::geometry_t geo) {
     }
 }
 
+void Workspace::request_occlusion_update() {
+    if (!idle_update_occlusion.is_connected())
+        idle_update_occlusion.run_once([&]() { update_occlusion(); });
+}
+
+void Workspace::update_occlusion() {
+    // Output region covered by the views processed so far.
+    wf::region_t covered;
+
+    // Whether a fullscreen view was processed, hiding everything below it.
+    bool below_fullscreen = false;
+
+    // Views are listed from the top of the stack to the bottom so a tiled
+    // view can only be covered by the views preceding it.
+    for (auto &view :
+         output->workspace->get_views_in_layer(wf::LAYER_WORKSPACE)) {
+        auto node = view_nodes->find(view);
+        if (!node || node->get_ws().get() != this)
+            continue;
+
+        auto geo = to_output_geometry(node->get_geometry());
+        bool floating = (bool)node->find_floating_parent();
+
+        node->set_hidden(HideReason::OCCLUDED,
+                         below_fullscreen ||
+                             (!floating &&
+                              (wf::region_t{geo} ^ covered).empty()));
+
+        if (!view->is_mapped() || view->minimized ||
+            node->get_hidden(HideReason::INACTIVE_TAB))
+            continue;
+
+        if (node->fullscreen) {
+            below_fullscreen = true;
+        } else if (floating) {
+            // Only the opaque parts of a floating view hide what is below it,
+            // and its rounded corners don't.
+            auto opaque = view->get_opaque_region(
+                wf::origin(view->get_output_geometry()));
+            opaque.expand_edges(-std::max(0, (int)corner_radius));
+            covered |= opaque & geo;
+        }
+    }
+}
+
+void Workspace::defer_layout() { layout_deferred++; }
+
+void Workspace::commit_layout() {
+    if (layout_deferred == 0 || --layout_deferred > 0 || !layout_dirty)
+        return;
+
+    layout_dirty = false;
+    refresh_layout();
+}
+
+void Workspace::refresh_layout() {
+    if (try_defer_layout())
+        return;
+
+    tiled_root->refresh_geometry();
+
+    for (auto &floating : floating_nodes)
+        floating->refresh_geometry();
+}
+
+void Workspace::defer_layout_until_idle() {
+    if (idle_commit_layout.is_connected())
+        return;
+
+    defer_layout();
+    idle_commit_layout.run_once([&]() {
+        remove_empty_splits();
+        commit_layout();
+    });
+}
+
+void Workspace::remove_empty_splits() {
+    tiled_root->remove_empty_splits();
+
+    for (std::size_t i = 0; i < floating_nodes.size();) {
+        if (auto split = floating_nodes[i]->as_split_node()) {
+            split->remove_empty_splits();
+
+            if (split->children.empty()) {
+                auto owned = remove_floating_node(split);
+                node_removed(owned.get());
+                continue;
+            }
+        }
+        i++;
+    }
+}
+
+bool Workspace::try_defer_layout() {
+    if (layout_deferred == 0)
+        return false;
+
+    layout_dirty = true;
+    return true;
+}
+
 void Workspace::toggle_tile_node(Node node) {
     LOGD("toggling tiling for ", node);
 
@@ -946,36 +1639,167 @@ bool Workspace::move_child(Node node, Direction dir) {
 
 // Workspaces
 
-void Workspaces::update_dims(wf::dimensions_t ndims, wf::geometry_t geo,
-                             OutputRef output) {
+void Workspaces::update_dims(wf::dimensions_t ndims, OutputRef output) {
+    dims = ndims;
+    this->output = output;
 
-    workspaces.resize(ndims.width);
-
-    auto x = 0;
-    for (auto &col : workspaces) {
-        if (col.size() == (uint32_t)ndims.height) {
-            // noop
-        } else if (col.size() < (uint32_t)ndims.height) {
-            col.reserve(ndims.height);
-            for (int32_t y = col.size(); y < ndims.height; y++) {
-                col.push_back(std::unique_ptr<Workspace>(
-                    new Workspace({x, y}, geo, output)));
-            }
+    for (auto it = workspaces.begin(); it != workspaces.end();) {
+        auto wsid = it->first;
+        if (wsid.x >= dims.width || wsid.y >= dims.height) {
+            unname(it->second.get());
+            it = workspaces.erase(it);
         } else {
-            col.erase(col.begin() + ndims.height, col.end());
+            ++it;
         }
-        x++;
     }
 }
 
 WorkspaceRef Workspaces::get(wf::point_t ws) {
-    return workspaces.at(ws.x).at(ws.y).get();
+    if (ws.x < 0 || ws.y < 0 || ws.x >= dims.width || ws.y >= dims.height)
+        throw std::out_of_range("Workspace out of the workspace grid");
+
+    auto &slot = workspaces[ws];
+    if (!slot) {
+        slot = std::make_unique<Workspace>(
+            ws, output->workspace->get_workarea(), output, view_nodes);
+        LOGD("allocated ", slot.get());
+    }
+
+    return slot.get();
+}
+
+WorkspaceRef Workspaces::find(wf::point_t ws) {
+    auto it = workspaces.find(ws);
+    if (it == workspaces.end())
+        return nullptr;
+
+    return it->second.get();
+}
+
+WorkspaceRef Workspaces::get_named(const std::string &name) {
+    auto named = names.find(name);
+    if (named != names.end())
+        return get(named->second);
+
+    auto is_free = [&](wf::point_t wsid) {
+        auto ws = find(wsid);
+        return !ws || ws->name.empty();
+    };
+
+    std::optional<wf::point_t> wsid;
+
+    // Numbered names prefer the cell of their number.
+    char *end = nullptr;
+    auto num = std::strtol(name.c_str(), &end, 10);
+    if (end != name.c_str() && num > 0 && num <= dims.width * dims.height) {
+        wf::point_t numbered = {(int)(num - 1) % dims.width,
+                                (int)(num - 1) / dims.width};
+        if (is_free(numbered))
+            wsid = numbered;
+    }
+
+    for (int y = 0; !wsid && y < dims.height; y++)
+        for (int x = 0; !wsid && x < dims.width; x++)
+            if (!find({x, y}))
+                wsid = {x, y};
+
+    if (!wsid) {
+        LOGE("No free workspace left for ", name);
+        return nullptr;
+    }
+
+    auto ws = get(*wsid);
+    ws->name = name;
+    names[name] = *wsid;
+
+    return ws;
+}
+
+void Workspaces::unname(WorkspaceRef ws) {
+    if (!ws->name.empty()) {
+        names.erase(ws->name);
+        ws->name.clear();
+    }
+}
+
+void Workspaces::release_unused() {
+    auto curr = output->workspace->get_current_workspace();
+
+    for (auto it = workspaces.begin(); it != workspaces.end();) {
+        if (it->first != curr && it->second->is_empty()) {
+            LOGD("releasing ", it->second.get());
+            unname(it->second.get());
+            it = workspaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 void Workspaces::for_each(const std::function<void(WorkspaceRef)> &fun) {
-    for (auto &col : workspaces)
-        for (auto &ws : col)
-            fun(ws.get());
+    for (auto &[_, ws] : workspaces)
+        fun(ws.get());
+}
+
+// Scratchpad
+
+void Scratchpad::insert_child(OwnedNode node) {
+    node->set_hidden(HideReason::SCRATCHPAD, true);
+    node->set_ws(nullptr);
+    node->parent = this;
+    nodes.push_back(std::move(node));
+}
+
+OwnedNode Scratchpad::pop() {
+    if (nodes.empty())
+        return nullptr;
+
+    auto node = std::move(nodes.front());
+    nodes.pop_front();
+
+    node->set_hidden(HideReason::SCRATCHPAD, false);
+    node->parent = nullptr;
+
+    return node;
+}
+
+OwnedNode Scratchpad::remove_child(Node node) {
+    auto child = std::find_if(nodes.begin(), nodes.end(), [&](auto &n) {
+        return n.get() == node.get();
+    });
+    if (child == nodes.end()) {
+        LOGE("Node not in ", this, ": ", node);
+        return nullptr;
+    }
+
+    auto owned_node = std::move(*child);
+    nodes.erase(child);
+
+    owned_node->set_hidden(HideReason::SCRATCHPAD, false);
+    owned_node->parent = nullptr;
+
+    return owned_node;
+}
+
+OwnedNode Scratchpad::swap_child(Node node, OwnedNode other) {
+    auto child = std::find_if(nodes.begin(), nodes.end(), [&](auto &n) {
+        return n.get() == node.get();
+    });
+    if (child == nodes.end()) {
+        LOGE("Node not in ", this, ": ", node);
+        return nullptr;
+    }
+
+    other->set_hidden(HideReason::SCRATCHPAD, true);
+    other->set_ws(nullptr);
+    other->parent = this;
+
+    child->swap(other);
+
+    other->set_hidden(HideReason::SCRATCHPAD, false);
+    other->parent = nullptr;
+
+    return other;
 }
 
 // Swayfire
@@ -985,51 +1809,179 @@ WorkspaceRef Swayfire::get_current_workspace() {
     return workspaces.get(wsid);
 }
 
-std::unique_ptr<ViewNode> Swayfire::init_view_node(wayfire_view view) {
-    auto node = std::make_unique<ViewNode>(view);
-    view->store_data<ViewData>(std::make_unique<ViewData>(node));
+void Swayfire::switch_to_workspace(WorkspaceRef ws) {
+    output->workspace->set_workspace(ws->wsid);
+}
+
+void Swayfire::move_to_workspace(Node node, WorkspaceRef ws) {
+    auto old_ws = node->get_ws();
+    if (old_ws == ws)
+        return;
+
+    if (old_ws->fullscreen_node)
+        old_ws->fullscreen_node->set_fullscreen(false);
+
+    bool floating = node->get_floating();
+    auto owned = old_ws->remove_node(node);
+    old_ws->node_removed(node);
+
+    if (floating) {
+        ws->insert_floating_node(std::move(owned));
+
+        // Floating splits keep their geometry when floated so their children
+        // must be repositioned in the new ws explicitly.
+        if (node->as_split_node() && !ws->try_defer_layout())
+            node->refresh_geometry();
+    } else {
+        ws->insert_tiled_node(std::move(owned));
+    }
+
+    if (old_ws == get_current_workspace())
+        if (auto active = old_ws->get_active_node())
+            active->set_active();
+}
+
+std::unique_ptr<ViewNode> Swayfire::init_view_node(wayfire_view view,
+                                                   WorkspaceRef ws) {
+    auto node = std::make_unique<ViewNode>(view, &view_nodes, ws);
 
     LOGD("New view-node for ", view->to_string(), ": ", node.get());
     return node;
 }
 
+void Swayfire::attach_pending_views() {
+    auto views = std::move(pending_views);
+    pending_views.clear();
+
+    std::vector<WorkspaceRef> deferred;
+    ViewNodeRef focused;
+    bool focus_assigned_away = false;
+
+    for (auto &view : views) {
+        if (view_nodes.find(view))
+            continue;
+
+        if (!view->is_mapped()) {
+            pending_views.push_back(view);
+            continue;
+        }
+
+        auto ws = workspaces.get(nonwf::get_view_workspace(view, output));
+        auto node = init_view_node(view, ws);
+
+        // Rules are applied before the insertion so they cost no extra
+        // layout pass.
+        auto actions = rule_index->evaluate(node.get());
+        if (actions.workspace)
+            if (auto assigned = workspaces.get_named(*actions.workspace))
+                ws = assigned;
+
+        if (std::find(deferred.begin(), deferred.end(), ws) == deferred.end()) {
+            ws->defer_layout();
+            deferred.push_back(ws);
+        }
+
+        LOGD("attaching node in ", ws, ", ", view->to_string(), " : ",
+             view->get_title());
+
+        for (auto &mark : actions.marks)
+            mark_node(node.get(), mark, true);
+
+        if (actions.size) {
+            auto &geo = node->floating_geometry;
+            wf::dimensions_t size = {
+                actions.size->width ? actions.size->width : geo.width,
+                actions.size->height ? actions.size->height : geo.height};
+
+            geo.x += (geo.width - size.width) / 2;
+            geo.y += (geo.height - size.height) / 2;
+            geo.width = size.width;
+            geo.height = size.height;
+        }
+
+        if (view == output->get_active_view()) {
+            focus_assigned_away = ws != get_current_workspace();
+            focused = focus_assigned_away ? nullptr : node.get();
+        }
+
+        if (actions.floating.value_or(false))
+            ws->insert_floating_node(std::move(node));
+        else
+            ws->insert_tiled_node(std::move(node));
+    }
+
+    for (auto &ws : deferred)
+        ws->commit_layout();
+
+    // The view was focused before it had a node to activate.
+    if (focused)
+        focused->set_active();
+    else if (focus_assigned_away)
+        if (auto active = get_current_workspace()->get_active_node())
+            active->set_active();
+}
+
 void Swayfire::bind_signals() {
     output->connect_signal("view-layer-attached", &on_view_attached);
+    output->connect_signal("view-mapped", &on_view_mapped);
+    output->connect_signal("view-disappeared", &on_view_disappeared);
+    output->connect_signal("view-layer-detached", &on_view_disappeared);
+    output->connect_signal("view-fullscreen-request", &on_view_fullscreen);
+    output->connect_signal("view-focused", &on_view_focused);
+    output->connect_signal("workspace-changed", &on_workspace_changed);
 }
 
 void Swayfire::unbind_signals() {
+    output->disconnect_signal(&on_workspace_changed);
+    output->disconnect_signal(&on_view_focused);
+    output->disconnect_signal(&on_view_fullscreen);
+    output->disconnect_signal(&on_view_disappeared);
+    output->disconnect_signal(&on_view_mapped);
     output->disconnect_signal(&on_view_attached);
+    idle_attach_views.disconnect();
+    pending_views.clear();
 }
 
 void Swayfire::init() {
     LOGD("==== init ====");
     output->workspace->set_workspace_implementation(
-        std::make_unique<SwayfireWorkspaceImpl>(), true);
+        std::make_unique<SwayfireWorkspaceImpl>(&view_nodes), true);
 
     auto grid_dims = output->workspace->get_workspace_grid_size();
 
-    workspaces.update_dims(grid_dims, output->workspace->get_workarea(),
-                           output);
+    workspaces.view_nodes = &view_nodes;
+    workspaces.update_dims(grid_dims, output);
 
     auto views = output->workspace->get_views_in_layer(wf::ALL_LAYERS);
 
     for (auto view : views) {
         if (view->role == wf::VIEW_ROLE_TOPLEVEL) {
             auto ws = workspaces.get(nonwf::get_view_workspace(view, output));
-            ws->insert_tiled_node(init_view_node(view));
+            ws->insert_tiled_node(init_view_node(view, ws));
         }
     }
 
     if (auto active_view = output->get_active_view()) {
-        if (auto vdata = active_view->get_data<ViewData>()) {
-            vdata->node->set_active();
+        if (auto node = view_nodes.find(active_view)) {
+            node->set_active();
         }
     }
 
     init_grab_interface();
+    decorations = std::make_unique<Decorations>(output, &view_nodes);
+    thumbnails = std::make_unique<Thumbnails>(output);
+
+    rule_index = std::make_unique<WindowRules>();
+    load_window_rules();
+    window_rules.set_callback([&]() { load_window_rules(); });
 
     bind_signals();
     bind_keys();
+
+    mode_bindings.set_callback([&]() {
+        unbind_keys();
+        bind_keys();
+    });
 }
 
 void Swayfire::fini() {
@@ -1039,11 +1991,15 @@ void Swayfire::fini() {
     unbind_signals();
 
     fini_grab_interface();
+    decorations = nullptr;
+    thumbnails = nullptr;
+    rule_index = nullptr;
 
     if (!is_shutting_down()) {
         // Destroy all workspaces, which will destroy all managed nodes and
         // detach custom data from the managed views.
         workspaces.workspaces.clear();
+        scratchpad.clear();
     }
 
     output->workspace->set_workspace_implementation(nullptr, true);
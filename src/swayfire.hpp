@@ -3,11 +3,15 @@
 
 #include <bits/stdint-intn.h>
 #include <bits/stdint-uintn.h>
+#include <deque>
 #include <memory>
 #include <sys/types.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
+#include <wayfire/config/compound-option.hpp>
 #include <wayfire/config/types.hpp>
 #include <wayfire/core.hpp>
 #include <wayfire/geometry.hpp>
@@ -17,7 +21,11 @@
 #include <wayfire/option-wrapper.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/plugin.hpp>
+#include <wayfire/region.hpp>
+#include <wayfire/render-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/duration.hpp>
 #include <wayfire/util/log.hpp>
 #include <wayfire/view-transform.hpp>
 #include <wayfire/workspace-manager.hpp>
@@ -25,6 +33,19 @@
 #define FLOATING_MOVE_STEP 5
 #define MIN_VIEW_SIZE 20
 
+/// Time in ms after which a configure that was not acked is given up on.
+#define CONFIGURE_TIMEOUT 100
+
+/// Output signal emitted when decorations are damaged.
+#define DECORATIONS_DAMAGED_SIGNAL "swayfire-decorations-damaged"
+
+/// Output signal emitted when a node is removed from a ws.
+#define NODE_REMOVED_SIGNAL "swayfire-node-removed"
+
+/// Output signal emitted when the views of a node may gain or lose their
+/// rounded corners.
+#define CORNERS_CHANGED_SIGNAL "swayfire-corners-changed"
+
 using OutputRef = nonstd::observer_ptr<wf::output_t>;
 
 /// Small wayfire helpers.
@@ -32,15 +53,17 @@ namespace nonwf {
 
 wf::point_t get_view_workspace(wayfire_view view, OutputRef output);
 
-/// Convert geo from from_wsid to to_wsid coordinate space.
-wf::geometry_t local_to_relative_geometry(wf::geometry_t geo,
-                                          wf::point_t from_wsid,
-                                          wf::point_t to_wsid,
-                                          OutputRef output);
-
 /// Get the center point of a geo.
 wf::point_t geometry_center(wf::geometry_t geo);
 
+/// Hash of a point for use as a key in unordered containers.
+struct PointHash {
+    std::size_t operator()(wf::point_t p) const {
+        return std::hash<uint64_t>{}(((uint64_t)(uint32_t)p.x << 32) |
+                                     (uint32_t)p.y);
+    }
+};
+
 #define NONWF_ALL_EDGES                                                        \
     (WLR_EDGE_LEFT | WLR_EDGE_RIGHT | WLR_EDGE_TOP | WLR_EDGE_BOTTOM)
 
@@ -53,6 +76,15 @@ enum struct SplitType : uint8_t {
     STACKED,
 };
 
+/// The reasons for which swayfire hides a view.
+///
+/// A view is hidden as long as it has at least one reason to be.
+enum struct HideReason : uint8_t {
+    OCCLUDED = 1 << 0,     ///< Fully covered by other nodes.
+    SCRATCHPAD = 1 << 1,   ///< Parked in the scratchpad.
+    INACTIVE_TAB = 1 << 2, ///< Not the active child of a tabbed/stacked split.
+};
+
 enum struct Direction : uint8_t {
     UP,
     DOWN,
@@ -197,6 +229,9 @@ class INode : public virtual IDisplay {
     /// Dynamic cast to ViewNodeRef.
     ViewNodeRef as_view_node();
 
+    /// Get the id of this node.
+    uint get_id() { return node_id; }
+
     /// Get the outer geometry of the node.
     virtual wf::geometry_t get_geometry() { return geometry; }
 
@@ -219,6 +254,13 @@ class INode : public virtual IDisplay {
     /// applied.
     virtual void try_resize(wf::dimensions_t ndims, uint32_t edges);
 
+    /// Get the outer geometry resulting from resizing to ndims by moving the
+    /// given edges, without applying it.
+    wf::geometry_t calc_resize(wf::dimensions_t ndims, uint32_t edges);
+
+    /// Set whether this node and its children are hidden for a reason.
+    virtual void set_hidden(HideReason reason, bool hidden) = 0;
+
     /// Get whether this node is floating.
     bool get_floating() { return floating; };
 
@@ -250,44 +292,51 @@ class INode : public virtual IDisplay {
 ///
 /// Currently waiting on https://github.com/WayfireWM/wayfire/issues/995 which
 /// is planned for wayfire 0.9.
+///
+/// The enforcer is only attached while the committed geometry of the view
+/// disagrees with its node: any transformer forces the view through the
+/// transformed render path and rules out direct scanout.
 class ViewGeoEnforcer : public wf::view_2D {
   private:
     ViewNodeRef view_node;
 
-    /// Handle the view changing geometry.
-    wf::signal_connection_t on_geometry_changed = [&](wf::signal_data_t *) {
-        update_transformer();
-    };
-
   public:
     ViewGeoEnforcer(ViewNodeRef node);
 
-    ~ViewGeoEnforcer() override;
-
     /// Update the scaling and offset to enforce the geometry.
     void update_transformer();
 };
 
-struct ViewData;
+class ViewNodeIndex;
 
 /// A node corresponding to a wayfire view.
 class ViewNode : public INode {
     friend ViewGeoEnforcer;
+    friend Workspace;
 
   private:
     /// Handle the view being mapped.
     wf::signal_connection_t on_mapped = [&](wf::signal_data_t *) {
-        if (view->tiled_edges != wf::TILED_EDGES_ALL)
-            floating_geometry = view->get_wm_geometry();
+        // can't inline it here since depends on ws methods.
+        on_mapped_impl();
     };
 
-    /// Handle the view being focused.
-    wf::signal_connection_t on_focused = [&](wf::signal_data_t *data) {
-        // The focused event is not directly available on views.
-        if (view.get() == wf::get_signaled_view(data).get())
-            set_active();
+    /// Records the initial floating geometry of the view.
+    void on_mapped_impl();
+
+    /// Handle the view changing geometry.
+    wf::signal_connection_t on_geometry_changed = [&](wf::signal_data_t *) {
+        // Layout changes update everything themselves after moving the view.
+        if (moving)
+            return;
+
+        check_configure_acked();
+        update_geo_enforcer();
     };
 
+    /// Whether the view is being moved along with a layout change.
+    bool moving = false;
+
     /// Handle unmapped views.
     wf::signal_connection_t on_unmapped = [&](wf::signal_data_t *) {
         // can't inline it here since depends on ws methods.
@@ -297,6 +346,62 @@ class ViewNode : public INode {
     /// Destroys the view node and the custom data attached to the view.
     void on_unmapped_impl();
 
+    /// The HideReason bits for which the view is currently hidden.
+    uint8_t hide_reasons = 0;
+
+    /// The size requested by the configure in flight, if any.
+    std::optional<wf::dimensions_t> configure_in_flight;
+
+    /// The committed size of the view when the configure in flight was sent.
+    wf::dimensions_t configure_base;
+
+    /// Whether the node was resized while a configure was in flight.
+    bool configure_pending = false;
+
+    /// Timer giving up on the configure in flight.
+    wf::wl_timer configure_timeout;
+
+    /// Send the size of this node to the client.
+    ///
+    /// Only one configure is in flight at a time: while the client hasn't
+    /// acked the previous one, the new size is held back and the geo enforcer
+    /// shows the latest geometry instead.
+    void configure();
+
+    /// Configure the client after a layout change of this node.
+    ///
+    /// While the layout of the ws is deferred, the configure is left to the
+    /// layout commit instead.
+    void layout_configure();
+
+    /// Acknowledge the configure in flight if the client committed a new size.
+    ///
+    /// If no configure is in flight and the client resized on its own, a
+    /// floating node adopts the new size while a tiled one reconfigures the
+    /// client back to its size.
+    void check_configure_acked();
+
+    /// Forget the configure in flight and send the held back one, if any.
+    void configure_acked();
+
+    /// The displayed geometry the layout animation started from.
+    wf::geometry_t animation_from;
+
+    /// The ws whose layout animation moves this node, if any.
+    WorkspaceRef animation_ws;
+
+    /// Animate the displayed geometry from the given one to the node's.
+    void start_animation(wf::geometry_t from);
+
+    /// Leave the layout animation, if any.
+    void stop_animation();
+
+    /// Get the ws local geometry covered by the view while fullscreen.
+    wf::geometry_t get_fullscreen_geometry();
+
+    /// The index this node is registered in.
+    nonstd::observer_ptr<ViewNodeIndex> index;
+
   public:
     /// The wayfire view corresponding to this node.
     wayfire_view view;
@@ -310,10 +415,74 @@ class ViewNode : public INode {
     /// The prefered split type for upgrading this node to a split node.
     std::optional<SplitType> prefered_split_type;
 
-    /// The geo enforcer transformer attached to the view.
+    /// The marks of this node, each unique among all nodes.
+    std::unordered_set<std::string> marks;
+
+    /// The geo enforcer transformer attached to the view, if any.
     nonstd::observer_ptr<ViewGeoEnforcer> geo_enforcer;
 
-    ViewNode(wayfire_view view);
+    /// Attach the geo enforcer if the committed geometry of the view differs
+    /// from the displayed geometry of this node, or detach it if they match.
+    void update_geo_enforcer();
+
+    /// Get the geometry the view should currently be displayed at.
+    ///
+    /// This is the node geometry unless a layout animation is running.
+    wf::geometry_t get_display_geometry();
+
+    /// Whether the view demands attention.
+    bool urgent = false;
+
+    /// The title of the view its decorations were last invalidated for.
+    std::string title;
+
+    /// Whether this node is asking the compositor to focus its view.
+    ///
+    /// The compositor signals the focus change back while the request is
+    /// being handled, this echo must not activate the node a second time.
+    bool requesting_focus = false;
+
+    /// Whether the view covers its whole output outside of the layout.
+    bool fullscreen = false;
+
+    /// Enter or leave fullscreen.
+    ///
+    /// While fullscreen, the view covers the whole output without borders or
+    /// transformers and layout passes only record the geometry of the node
+    /// for when it leaves fullscreen. At most one node per ws is fullscreen.
+    void set_fullscreen(bool fs);
+
+    /// Get the geometry of the view inside the borders of the given outer
+    /// geometry.
+    wf::geometry_t to_view_geometry(wf::geometry_t outer);
+
+    /// Get the outer geometry whose borders surround the given view geometry.
+    wf::geometry_t to_outer_geometry(wf::geometry_t inner);
+
+    /// Get the output geometry the view should currently be displayed at.
+    wf::geometry_t get_target_view_geometry();
+
+    /// Get the output region covered by the currently displayed border and
+    /// title bar.
+    wf::region_t get_border_region();
+
+    /// Damage the currently displayed border and title bar.
+    void damage_border();
+
+    /// Get the height of the title bar of this node.
+    ///
+    /// Children of tabbed and stacked splits are titled in the header of their
+    /// parent instead.
+    int get_title_height();
+
+    /// Get the output geometry of the text area of the currently displayed
+    /// title bar, if any.
+    std::optional<wf::geometry_t> get_title_geometry();
+
+    /// Make a node for the view in the given ws and register it in the index,
+    /// the options of the ws sizing its decorations until it is inserted.
+    ViewNode(wayfire_view view, nonstd::observer_ptr<ViewNodeIndex> index,
+             WorkspaceRef ws);
 
     ~ViewNode() override;
 
@@ -325,6 +494,11 @@ class ViewNode : public INode {
     /// is cleared.
     SplitNodeRef try_upgrade();
 
+    /// Get whether the view is hidden for the given reason.
+    bool get_hidden(HideReason reason) {
+        return hide_reasons & (uint8_t)reason;
+    }
+
     // == INode impl ==
 
     void set_geometry(wf::geometry_t geo) override;
@@ -332,6 +506,9 @@ class ViewNode : public INode {
     void set_active() override;
     NodeParent get_or_upgrade_to_parent_node() override;
 
+    /// Hidden views are not rendered, damaged or sent frame callbacks.
+    void set_hidden(HideReason reason, bool hidden) override;
+
     // == IDisplay impl ==
 
     std::ostream &to_stream(std::ostream &os) const override {
@@ -340,13 +517,34 @@ class ViewNode : public INode {
     }
 };
 
-/// The custom data attached to wayfire views to point to the corresponding view
-/// node.
-struct ViewData : wf::custom_data_t {
-    /// Pointer to the corresponding view node.
-    ViewNodeRef node;
+/// Index from wayfire views to their view nodes.
+///
+/// Wayfire's custom view data is looked up by the name of its type, which is
+/// too costly for the hooks wayfire calls on every interaction. The index is
+/// keyed by the view pointer instead. View nodes register themselves on
+/// creation and unregister on destruction.
+class ViewNodeIndex {
+  private:
+    std::unordered_map<wf::view_interface_t *, ViewNodeRef> nodes;
+
+  public:
+    /// Register a view node.
+    void insert(ViewNodeRef node) { nodes[node->view.get()] = node; }
+
+    /// Unregister a view node.
+    void erase(ViewNodeRef node) { nodes.erase(node->view.get()); }
+
+    /// Get the view node of a view, or nullptr if it is not managed.
+    ViewNodeRef find(wayfire_view view) const {
+        auto it = nodes.find(view.get());
+        return it == nodes.end() ? nullptr : it->second;
+    }
 
-    ViewData(ViewNodeRef node) : node(node) {}
+    /// Iterate through all the view nodes.
+    void for_each(const std::function<void(ViewNodeRef)> &fun) const {
+        for (auto &[view, node] : nodes)
+            fun(node);
+    }
 };
 
 /// A child of a split node.
@@ -378,13 +576,44 @@ class SplitNode : public INode, public INodeParent {
     /// horizontal.
     SplitNodeRef find_parent_split(bool horiz);
 
+    /// Whether this node is hidden as an inactive tab of a parent.
+    bool tab_hidden = false;
+
+    /// Hide all the children but the active one if this split is tabbed or
+    /// stacked and invalidate its header.
+    void update_tabs();
+
+    /// Get the height of the header of this split.
+    int get_header_height();
+
+    /// Damage the currently displayed header of this split.
+    void damage_header();
+
   public:
     SplitType split_type = SplitType::VSPLIT; ///< The split type of this node.
     uint32_t active_child = 0;                ///< Index of last active child.
     std::vector<SplitChild> children;         ///< The direct children nodes.
 
+    /// Version of the header contents, bumped whenever it must be redrawn.
+    uint64_t header_version = 0;
+
     SplitNode(wf::geometry_t geo) { geometry = geo; }
 
+    /// Get whether this split shows only its active child under a header.
+    bool is_tabbed() {
+        return split_type == SplitType::TABBED ||
+               split_type == SplitType::STACKED;
+    }
+
+    /// Get the output geometry of the header of this split, if any.
+    std::optional<wf::geometry_t> get_header_geometry();
+
+    /// Bump the header version and damage the header.
+    void invalidate_header();
+
+    /// Set the split type of this node and relayout its children.
+    void set_split_type(SplitType type);
+
     /// Insert a direct child at the given position in children.
     void insert_child_at(SplitChildIter at, OwnedNode node);
 
@@ -406,6 +635,12 @@ class SplitNode : public INode, public INodeParent {
     /// Toggle the split direction of this node.
     void toggle_split_direction();
 
+    /// Grow a direct child by delta px along the split direction.
+    ///
+    /// The space is taken from or given to its siblings in proportion to
+    /// their sizes. Returns false if the child can't be resized.
+    bool resize_child(Node node, int delta);
+
     /// Try to downgrade this node to its only child node.
     ///
     /// A split node is only downgradable if it contains exactly one direct
@@ -414,6 +649,9 @@ class SplitNode : public INode, public INodeParent {
     /// preference of it is set to the split type that this split was.
     Node try_downgrade();
 
+    /// Remove the descendant splits of this node left without children.
+    void remove_empty_splits();
+
     // == INodeParent impl ==
 
     Node get_adjacent(Node node, Direction dir) override;
@@ -431,6 +669,7 @@ class SplitNode : public INode, public INodeParent {
     void set_geometry(wf::geometry_t geo) override;
     void set_floating(bool fl) override;
     void set_ws(WorkspaceRef ws) override;
+    void set_hidden(HideReason reason, bool hidden) override;
     NodeParent get_or_upgrade_to_parent_node() override;
 
     // == IDisplay impl ==
@@ -441,6 +680,24 @@ class SplitNode : public INode, public INodeParent {
     }
 };
 
+/// Data of DECORATIONS_DAMAGED_SIGNAL.
+struct DecorationsDamagedSignal : public wf::signal_data_t {
+    /// The node whose decorations are damaged, if any.
+    Node node;
+};
+
+/// Data of NODE_REMOVED_SIGNAL.
+struct NodeRemovedSignal : public wf::signal_data_t {
+    /// The removed node, which may be destroyed right after the signal.
+    Node node;
+};
+
+/// Data of CORNERS_CHANGED_SIGNAL.
+struct CornersChangedSignal : public wf::signal_data_t {
+    /// The node whose views must be updated.
+    Node node;
+};
+
 /// A single workspace managing a tiled tree and floating nodes.
 class Workspace : public INodeParent {
   public:
@@ -453,6 +710,9 @@ class Workspace : public INodeParent {
     /// The position of this ws on the ws grid.
     wf::point_t wsid;
 
+    /// The name of this ws or empty if it is only addressed by its wsid.
+    std::string name;
+
     /// The tiled tree that fills this workspace.
     std::unique_ptr<SplitNode> tiled_root;
 
@@ -464,6 +724,26 @@ class Workspace : public INodeParent {
     /// The wayfire output that this workspace is on.
     OutputRef output;
 
+    /// The view nodes of the output.
+    nonstd::observer_ptr<ViewNodeIndex> view_nodes;
+
+    /// The fullscreen view node of this ws, if any.
+    ViewNodeRef fullscreen_node;
+
+    /// Width of the border drawn around the views.
+    wf::option_wrapper_t<int> border_width{"swayfire/border_width"};
+
+    /// Height of the title bars and of the rows of the headers of tabbed
+    /// and stacked splits, 0 to disable them.
+    wf::option_wrapper_t<int> title_height{"swayfire/title_height"};
+
+    /// Duration of layout animations in ms, 0 to disable them.
+    wf::option_wrapper_t<int> animation_duration{
+        "swayfire/animation_duration"};
+
+    /// Radius of the rounded corners of floating nodes.
+    wf::option_wrapper_t<int> corner_radius{"swayfire/corner_radius"};
+
   private:
     /// Reference to the node currently active in this ws.
     Node active_node;
@@ -483,8 +763,49 @@ class Workspace : public INodeParent {
         set_workarea(wcdata->new_workarea);
     };
 
+    /// Idle call to recompute the occlusion of the tiled views.
+    wf::wl_idle_call idle_update_occlusion;
+
+    /// Lay out the tiled tree and the floating nodes again, unless the
+    /// layout is deferred.
+    void refresh_layout();
+
+    /// Number of pending defer_layout() calls.
+    uint32_t layout_deferred = 0;
+
+    /// Whether the layout changed while it was deferred.
+    bool layout_dirty = false;
+
+    /// Idle call ending the layout deferral of defer_layout_until_idle().
+    wf::wl_idle_call idle_commit_layout;
+
+    /// The layout animation shared by all the animated nodes of this ws.
+    wf::animation::duration_t layout_animation{animation_duration};
+
+    /// The view nodes moved by the layout animation.
+    std::vector<ViewNodeRef> animated_nodes;
+
+    /// Whether the layout animation was started since the last frame.
+    bool animation_started = false;
+
+    /// Advance the layout animation on every output frame.
+    wf::effect_hook_t on_animation_frame = [&]() { animation_frame(); };
+
+    /// Update the geo enforcers of the animated nodes to the current step
+    /// of the layout animation.
+    void animation_frame();
+
+    /// Remove the splits of this ws left without children.
+    void remove_empty_splits();
+
+    /// Hide tiled views fully covered by the opaque parts of floating views
+    /// stacked above them and all the views below a fullscreen view, and
+    /// show the others.
+    void update_occlusion();
+
   public:
-    Workspace(wf::point_t wsid, wf::geometry_t geo, OutputRef output);
+    Workspace(wf::point_t wsid, wf::geometry_t geo, OutputRef output,
+              nonstd::observer_ptr<ViewNodeIndex> view_nodes);
 
     Workspace(const Workspace &) = delete;
     Workspace const &operator=(const Workspace &) = delete;
@@ -502,9 +823,45 @@ class Workspace : public INodeParent {
     /// Set the workarea of the workspace.
     void set_workarea(wf::geometry_t geo);
 
+    /// Animate the displayed geometry of a view node of this ws from the
+    /// given one to its node geometry.
+    ///
+    /// Only the geo enforcers are updated on each frame: the clients have
+    /// already been configured with their final geometry.
+    void animate_node(ViewNodeRef node, wf::geometry_t from);
+
+    /// Stop animating a view node, which is then displayed at its geometry.
+    void stop_animating(ViewNodeRef node);
+
+    /// Get the progress of the layout animation, from 0 to 1.
+    double get_animation_progress() { return layout_animation.progress(); }
+
     /// Get the workarea of the workspace.
     wf::geometry_t get_workarea() { return workarea; }
 
+    /// Get whether this ws manages no nodes at all.
+    bool is_empty() {
+        return tiled_root->children.empty() && floating_nodes.empty();
+    }
+
+    /// Get the offset of this ws's local coordinate space in the output's
+    /// coordinate space.
+    ///
+    /// Node geometries are local to their ws and never depend on the current
+    /// ws. This single offset is the only thing that changes when switching
+    /// workspaces and it is only applied when positioning views.
+    wf::point_t get_output_offset();
+
+    /// Convert a geometry local to this ws to output coordinates.
+    wf::geometry_t to_output_geometry(wf::geometry_t geo);
+
+    /// Damage a region of the output holding decorations of this ws.
+    ///
+    /// The renderer of the decorations is only hooked while there is
+    /// something to draw, this wakes it up. If a node is given, the shadow
+    /// around its floating parent is damaged too.
+    void damage_decorations(const wf::region_t &region, Node node = nullptr);
+
     // == Floating ==
 
     /// Insert a floating node into this workspace.
@@ -541,9 +898,40 @@ class Workspace : public INodeParent {
     /// Clean up after a node has been removed from this ws.
     void node_removed(Node node);
 
+    /// Update the rounded corners of the views of a node after it floated,
+    /// sank, moved to another parent or toggled fullscreen.
+    void corners_changed(Node node);
+
     /// Toggle tiling on a ndoe in this ws.
     void toggle_tile_node(Node node);
 
+    /// Schedule an occlusion update of the views in this ws.
+    ///
+    /// Updates are coalesced and run once the event loop is idle.
+    void request_occlusion_update();
+
+    /// Hold back the layout and the configures of this ws until the matching
+    /// commit_layout().
+    ///
+    /// Batches of tree changes then lay out and configure each view once
+    /// instead of once per change.
+    void defer_layout();
+
+    /// Lay out this ws once if its splits changed since defer_layout().
+    void commit_layout();
+
+    /// Hold back the layout of this ws until the event loop is idle.
+    ///
+    /// The nodes removed until then are laid out together and the splits
+    /// they leave empty are removed in a single pass.
+    void defer_layout_until_idle();
+
+    /// Record a layout change if the layout is deferred.
+    ///
+    /// \return Whether the layout is deferred and the caller must not lay
+    /// out now.
+    bool try_defer_layout();
+
     // == INodeParent impl ==
 
     Node get_adjacent(Node node, Direction dir) override;
@@ -558,39 +946,123 @@ class Workspace : public INodeParent {
 
     std::ostream &to_stream(std::ostream &os) const override {
         os << "workspace-" << wsid;
+        if (!name.empty())
+            os << "-" << name;
         return os;
     }
 };
 
 /// Grid of all the workspaces on an output.
+///
+/// Workspaces are stored sparsely: a cell of the grid is only allocated once
+/// it is used and is released again once it is empty and not current.
 struct Workspaces {
-    /// Workspace tree roots: workspaces[x][y].
-    std::vector<std::vector<std::unique_ptr<Workspace>>> workspaces;
+    /// The allocated workspaces keyed by their position in the grid.
+    std::unordered_map<wf::point_t, std::unique_ptr<Workspace>,
+                       nonwf::PointHash>
+        workspaces;
+
+    /// The dimensions of the workspace grid.
+    wf::dimensions_t dims = {0, 0};
+
+    /// The wayfire output that the workspaces are on.
+    OutputRef output;
+
+    /// The view nodes of the output.
+    nonstd::observer_ptr<ViewNodeIndex> view_nodes;
+
+    /// The grid positions of the named workspaces keyed by their name.
+    std::unordered_map<std::string, wf::point_t> names;
+
+    /// Forget the name of a workspace.
+    void unname(WorkspaceRef ws);
 
     /// Update the dimensions of the workspace grid.
-    void update_dims(wf::dimensions_t ndims, wf::geometry_t geo,
-                     OutputRef output);
+    ///
+    /// Allocated workspaces outside of the new grid are destroyed.
+    void update_dims(wf::dimensions_t ndims, OutputRef output);
 
     /// Get the workspace at the given coordinate in the grid.
+    ///
+    /// The workspace is allocated if it was not yet. Throws std::out_of_range
+    /// if the coordinate is outside of the grid.
     WorkspaceRef get(wf::point_t ws);
 
-    /// Iterate through all workspaces in the grid.
+    /// Get the workspace at the given coordinate if it is allocated.
+    WorkspaceRef find(wf::point_t ws);
+
+    /// Get the workspace with the given name, creating it on demand.
+    ///
+    /// A name starting with a number N, like "1:web", is placed on the N-th
+    /// cell of the grid in row-major order if that cell is not already named.
+    /// Other names take the first cell that is neither allocated nor named.
+    /// Returns nullptr if no cell is available.
+    WorkspaceRef get_named(const std::string &name);
+
+    /// Release the allocated workspaces that are empty and not current.
+    void release_unused();
+
+    /// Iterate through all allocated workspaces.
     void for_each(const std::function<void(WorkspaceRef)> &fun);
 };
 
+/// The scratchpad of an output.
+///
+/// Nodes sent to the scratchpad are detached from every workspace and hidden,
+/// so they are skipped by rendering and by all layout passes.
+class Scratchpad : public INodeParent {
+  private:
+    /// The parked nodes, from the oldest to the newest.
+    std::deque<OwnedNode> nodes;
+
+  public:
+    /// Get whether the scratchpad holds no nodes.
+    bool empty() { return nodes.empty(); }
+
+    /// Take the oldest node out of the scratchpad and show it again.
+    OwnedNode pop();
+
+    /// Destroy all the parked nodes.
+    void clear() { nodes.clear(); }
+
+    // == INodeParent impl ==
+
+    Node get_adjacent(Node, Direction) override { return nullptr; }
+    bool move_child(Node, Direction) override { return false; }
+    Node get_last_active_node() override { return nullptr; }
+    void insert_child(OwnedNode node) override;
+    OwnedNode remove_child(Node node) override;
+    OwnedNode swap_child(Node node, OwnedNode other) override;
+    void set_active_child(Node) override {}
+
+    // == IDisplay impl ==
+
+    std::ostream &to_stream(std::ostream &os) const override {
+        os << "scratchpad";
+        return os;
+    }
+};
+
 /// Custom wayfire workspace implementation.
 class SwayfireWorkspaceImpl : public wf::workspace_implementation_t {
+  private:
+    /// The view nodes of the output.
+    nonstd::observer_ptr<ViewNodeIndex> view_nodes;
+
   public:
+    SwayfireWorkspaceImpl(nonstd::observer_ptr<ViewNodeIndex> view_nodes)
+        : view_nodes(view_nodes) {}
+
     bool view_movable(wayfire_view view) override {
-        if (auto vdata = view->get_data<ViewData>())
-            return vdata->node->get_floating();
+        if (auto node = view_nodes->find(view))
+            return node->get_floating();
 
         return false;
     }
 
     bool view_resizable(wayfire_view view) override {
-        if (auto vdata = view->get_data<ViewData>())
-            return vdata->node->get_floating();
+        if (auto node = view_nodes->find(view))
+            return node->get_floating();
 
         return false;
     }
@@ -606,18 +1078,143 @@ class IActiveGrab;
 class IActiveButtonDrag;
 class ActiveMove;
 class ActiveResize;
+class ActiveOverview;
+
+class Decorations;
+class Thumbnails;
+class WindowRules;
+
+struct Command;
+struct CommandChain;
+
+/// The action run by a key binding.
+using BindingAction = std::function<bool(const wf::keybinding_t &)>;
+
+/// A set of key bindings that are active together, like sway's modes.
+///
+/// Every key option used by any mode is registered with the output once as a
+/// binding slot. The slots look up their action in the table of the current
+/// mode, so switching modes only swaps the current table.
+struct BindingMode {
+    /// The actions of the mode indexed by binding slot, empty if unbound.
+    std::vector<BindingAction> actions;
+
+    /// Bind an action to a slot in this mode.
+    void bind(std::size_t slot, BindingAction action) {
+        if (actions.size() <= slot)
+            actions.resize(slot + 1);
+        actions[slot] = std::move(action);
+    }
+};
+
+/// The name of the mode holding the built-in bindings.
+#define DEFAULT_BINDING_MODE "default"
 
 class Swayfire : public wf::plugin_interface_t {
   private:
+    /// The view nodes managed by swayfire.
+    ///
+    /// Declared first so that it outlives the nodes in the workspaces.
+    ViewNodeIndex view_nodes;
+
     /// The workspaces manages by swayfire.
     Workspaces workspaces;
 
-    /// Stores all the key callbacks bound.
+    /// The renderer of the node decorations.
+    std::unique_ptr<Decorations> decorations;
+
+    /// The cached workspace thumbnails of the overview.
+    std::unique_ptr<Thumbnails> thumbnails;
+
+    /// The nodes parked out of the workspaces.
+    Scratchpad scratchpad;
+
+    /// The key option of each binding slot.
+    std::vector<wf::option_sptr_t<wf::keybinding_t>> binding_slots;
+
+    /// The output callback of each binding slot.
     std::vector<std::unique_ptr<wf::key_callback>> key_callbacks;
 
+    /// The binding modes keyed by name.
+    std::unordered_map<std::string, BindingMode> binding_modes;
+
+    /// The table of the current binding mode.
+    nonstd::observer_ptr<BindingMode> current_mode;
+
+    /// The built-in actions keyed by the name of their binding.
+    std::unordered_map<std::string, BindingAction> builtin_actions;
+
+    /// The user bindings as (name, mode, key, action) tuples.
+    ///
+    /// An action is either the name of a built-in binding, like "focus_left",
+    /// or a command chain.
+    wf::option_wrapper_t<
+        wf::config::compound_list_t<std::string, wf::keybinding_t, std::string>>
+        mode_bindings{"swayfire/mode_bindings"};
+
+    /// Get the binding slot of a key option, registering it if needed.
+    std::size_t get_binding_slot(wf::option_sptr_t<wf::keybinding_t> key);
+
+    /// Bind an action to a key option in a mode.
+    ///
+    /// Unset keys are skipped. A key already bound in the mode is logged as
+    /// a conflict and the new action replaces the old one.
+    void bind_action(const std::string &mode,
+                     wf::option_sptr_t<wf::keybinding_t> key,
+                     BindingAction action);
+
+    /// Make the action of a user binding.
+    std::optional<BindingAction> parse_action(const std::string &action);
+
+    /// Make the binding mode with the given name the current one.
+    bool switch_mode(const std::string &name);
+
+    // == Commands ==
+
+    /// The parsed command chains keyed by their source.
+    std::unordered_map<std::string, std::shared_ptr<const CommandChain>>
+        command_cache;
+
+    /// Get the parsed command chain of a source, parsing it on a cache miss.
+    std::shared_ptr<const CommandChain>
+    compile_command(const std::string &source);
+
+    /// Run a parsed command chain, laying out the tree once at the end.
+    bool execute_command(const CommandChain &chain);
+
+    /// Run a single command on a target node.
+    bool execute_command(const Command &command, Node target);
+
+    /// Give a mark to a view node, taking it from any other node.
+    ///
+    /// The other marks of the node are kept if add is set.
+    void mark_node(ViewNodeRef node, const std::string &mark, bool add);
+
+    // == Window Rules ==
+
+    /// The window rules applied to new views, like
+    /// `for_window [app_id="^pavucontrol$"] floating enable`.
+    wf::option_wrapper_t<wf::config::compound_list_t<std::string>>
+        window_rules{"swayfire/window_rules"};
+
+    /// The compiled window rules.
+    std::unique_ptr<WindowRules> rule_index;
+
+    /// Compile the window rules from the config.
+    void load_window_rules();
+
     /// The current active gesture grab.
     std::unique_ptr<IActiveGrab> active_grab;
 
+    /// The latest pointer position of the active grab not yet applied.
+    std::optional<wf::point_t> pending_motion;
+
+    /// Apply the latest pointer motion of the active grab once per frame.
+    wf::effect_hook_t on_frame_motion = [&]() { flush_motion(); };
+
+    /// Forward the pending pointer motion, if any, to the active grab.
+    void flush_motion();
+
     /// Bind all signal handlers needed.
     void bind_signals();
 
@@ -631,7 +1228,8 @@ class Swayfire : public wf::plugin_interface_t {
     void unbind_keys();
 
     /// Make a new view_node corresponding to the given view.
-    std::unique_ptr<ViewNode> init_view_node(wayfire_view view);
+    std::unique_ptr<ViewNode> init_view_node(wayfire_view view,
+                                             WorkspaceRef ws);
 
     /// Initialize gesture grab interfaces and activators.
     void init_grab_interface();
@@ -643,14 +1241,24 @@ class Swayfire : public wf::plugin_interface_t {
     friend class IActiveButtonDrag;
     friend class ActiveMove;
     friend class ActiveResize;
+    friend class ActiveOverview;
 
     // == Bindings and Binding Callbacks ==
 
-    /// Focus the node in the given direction from the active node.
-    bool focus_direction(Direction dir);
+    /// Focus the node in the given direction from the given node.
+    bool focus_direction(Node node, Direction dir);
+
+    /// Move a node in the given direction.
+    bool move_direction(Node node, Direction dir);
+
+    /// Toggle focus between the tiled and floating nodes of a ws.
+    bool toggle_focus_tile(WorkspaceRef ws);
 
-    /// Move the active node in the given direction.
-    bool move_direction(Direction dir);
+    /// Move a node to the scratchpad.
+    bool send_to_scratchpad(Node node);
+
+    /// Show the oldest node of the scratchpad on the current ws.
+    bool show_scratchpad();
 
 #define DECL_KEY(NAME)                                                         \
     wf::option_wrapper_t<wf::keybinding_t> key_##NAME{"swayfire/key_" #NAME};  \
@@ -661,6 +1269,9 @@ class Swayfire : public wf::plugin_interface_t {
     DECL_KEY(set_want_vsplit);
     DECL_KEY(set_want_hsplit);
 
+    DECL_KEY(set_layout_tabbed);
+    DECL_KEY(set_layout_stacked);
+
     DECL_KEY(focus_left);
     DECL_KEY(focus_right);
     DECL_KEY(focus_down);
@@ -674,6 +1285,12 @@ class Swayfire : public wf::plugin_interface_t {
     DECL_KEY(move_up);
 
     DECL_KEY(toggle_tile);
+    DECL_KEY(toggle_fullscreen);
+
+    DECL_KEY(send_to_scratchpad);
+    DECL_KEY(show_scratchpad);
+
+    DECL_KEY(toggle_overview);
 #undef DECL_KEY
 
     wf::option_wrapper_t<wf::buttonbinding_t> button_move_activate{
@@ -682,29 +1299,117 @@ class Swayfire : public wf::plugin_interface_t {
     wf::option_wrapper_t<wf::buttonbinding_t> button_resize_activate{
         "swayfire/button_resize_activate"};
 
+    wf::option_wrapper_t<bool> resize_preview{"swayfire/resize_preview"};
+
+    wf::option_wrapper_t<wf::color_t> resize_preview_color{
+        "swayfire/resize_preview_color"};
+
     wf::button_callback on_move_activate;
     wf::button_callback on_resize_activate;
 
+    /// Drop the active grab if it acts on the given node.
+    void drop_grab_of(Node node);
+
+    /// Drop the active grab when the node it acts on is removed.
+    wf::signal_connection_t on_node_removed = [&](wf::signal_data_t *data) {
+        drop_grab_of(static_cast<NodeRemovedSignal *>(data)->node);
+    };
+
     // == Signal Handlers == //
 
+    /// Handle switching workspaces.
+    wf::signal_connection_t on_workspace_changed = [&](wf::signal_data_t *) {
+        workspaces.release_unused();
+    };
+
+    /// Handle focus changes.
+    ///
+    /// The focused event is not available on views, so a single handler
+    /// resolves the focused view to its node instead of every node checking
+    /// whether it is the one focused.
+    wf::signal_connection_t on_view_focused = [&](wf::signal_data_t *data) {
+        if (auto view = wf::get_signaled_view(data))
+            if (auto node = view_nodes.find(view))
+                if (!node->requesting_focus)
+                    node->set_active();
+    };
+
+    /// Handle views requesting to enter or leave fullscreen.
+    wf::signal_connection_t on_view_fullscreen = [&](wf::signal_data_t *data) {
+        auto signal = static_cast<wf::view_fullscreen_signal *>(data);
+        if (signal->carried_out)
+            return;
+
+        if (auto node = view_nodes.find(signal->view)) {
+            signal->carried_out = true;
+            node->set_fullscreen(signal->state);
+        }
+    };
+
+    /// The new views waiting to be attached.
+    std::vector<wayfire_view> pending_views;
+
+    /// Idle call attaching the pending views.
+    wf::wl_idle_call idle_attach_views;
+
+    /// Insert the pending views with one layout pass per ws.
+    ///
+    /// Views which aren't mapped yet stay pending until they are.
+    void attach_pending_views();
+
+    /// Attach the pending views once the event loop is idle.
+    void schedule_attach_views() {
+        if (!idle_attach_views.is_connected())
+            idle_attach_views.run_once([&]() { attach_pending_views(); });
+    }
+
     /// Handle new created views.
+    ///
+    /// Views are queued and attached together once the event loop is idle,
+    /// so that bursts of new views only lay out their workspace once.
     wf::signal_connection_t on_view_attached = [&](wf::signal_data_t *data) {
         auto view = wf::get_signaled_view(data);
 
         if (view->role != wf::VIEW_ROLE_TOPLEVEL)
             return;
 
-        auto ws = workspaces.get(nonwf::get_view_workspace(view, output));
-
-        LOGD("attaching node in ", ws, ", ", view->to_string(), " : ",
-             view->get_title());
+        pending_views.push_back(view);
+        schedule_attach_views();
+    };
 
-        ws->insert_tiled_node(init_view_node(view));
+    /// Attach pending views as soon as they are mapped.
+    wf::signal_connection_t on_view_mapped = [&](wf::signal_data_t *data) {
+        auto view = wf::get_signaled_view(data);
+        if (std::find(pending_views.begin(), pending_views.end(), view) !=
+            pending_views.end())
+            schedule_attach_views();
     };
 
+    /// Forget pending views that go away before being attached, either
+    /// unmapped or detached from the output before being mapped.
+    wf::signal_connection_t on_view_disappeared =
+        [&](wf::signal_data_t *data) {
+            auto view = wf::get_signaled_view(data);
+            pending_views.erase(std::remove(pending_views.begin(),
+                                            pending_views.end(), view),
+                                pending_views.end());
+        };
+
   public:
     WorkspaceRef get_current_workspace();
 
+    /// Make the given workspace the current one.
+    void switch_to_workspace(WorkspaceRef ws);
+
+    /// Move a node and its children to the given workspace.
+    void move_to_workspace(Node node, WorkspaceRef ws);
+
+    /// Run a sway command chain, like "focus left; move right".
+    ///
+    /// Parsed chains are cached so running the same source again skips the
+    /// parsing.
+    bool run_command(const std::string &source);
+
     // == Impl wf::plugin_interface_t ==
 
     void init() override;